@@ -0,0 +1,28 @@
+# Converts a SPIR-V binary into a C header that holds it as a word array.
+#
+# Usage: cmake -DINPUT=<file.spv> -DOUTPUT=<file.h> -DSYMBOL=<name> -P embed_spirv.cmake
+
+file(READ ${INPUT} SPIRV_HEX HEX)
+
+string(LENGTH "${SPIRV_HEX}" SPIRV_HEX_LENGTH)
+math(EXPR SPIRV_HEX_REMAINDER "${SPIRV_HEX_LENGTH} % 8")
+if(SPIRV_HEX_LENGTH EQUAL 0 OR NOT SPIRV_HEX_REMAINDER EQUAL 0)
+    message(FATAL_ERROR "${INPUT} is not a valid SPIR-V binary")
+endif()
+
+# SPIR-V is a stream of little-endian 32-bit words
+string(REGEX REPLACE "(..)(..)(..)(..)" "0x\\4\\3\\2\\1u, " SPIRV_WORDS "${SPIRV_HEX}")
+set(SPIRV_WORD "0x[0-9a-f]+u, ")
+string(REGEX REPLACE
+    "(${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD}${SPIRV_WORD})"
+    "\\1\n    " SPIRV_WORDS "${SPIRV_WORDS}")
+string(REPLACE ", \n" ",\n" SPIRV_WORDS "${SPIRV_WORDS}")
+string(REGEX REPLACE "[ \n]+$" "" SPIRV_WORDS "${SPIRV_WORDS}")
+
+get_filename_component(INPUT_NAME ${INPUT} NAME)
+file(WRITE ${OUTPUT}
+    "// Generated from ${INPUT_NAME} by embed_spirv.cmake, do not edit.\n"
+    "#include <stdint.h>\n\n"
+    "static const uint32_t ${SYMBOL}[] = {\n"
+    "    ${SPIRV_WORDS}\n"
+    "};\n")
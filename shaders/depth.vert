@@ -0,0 +1,14 @@
+#version 450
+
+layout(location = 0) in vec3 inPosition;
+
+layout(binding = 0) uniform UniformBufferObject {
+    mat4 mvp;
+    float colorToTextureRatio;
+} ubo;
+
+invariant gl_Position;
+
+void main() {
+    gl_Position = ubo.mvp * vec4(inPosition, 1.0);
+}
@@ -1,5 +1,15 @@
 #version 450
 
+// 0: triangle color only, 1: texture only, 2: blend of both,
+// 3: overdraw, 4: triangle density, 5: wireframe
+layout(constant_id = 0) const uint SHADING_MODE = 2;
+
+// Added per fragment by the additive debug views. Overdraw saturates red at
+// 10 layers. Density draws three points per triangle, so one triangle per
+// pixel reaches full blue.
+const vec4 OVERDRAW_STEP = vec4(0.1, 0.04, 0.01, 0.0);
+const vec4 DENSITY_STEP = vec4(0.04, 0.12, 0.34, 0.0);
+
 layout(location = 0) in flat uint triangleIndex;
 layout(location = 1) in vec2 fragTexCoord;
 layout(location = 2) in float colorToTextureRatio;
@@ -9,8 +19,33 @@ layout(location = 0) out vec4 outColor;
 layout(binding = 1) uniform sampler2D texSampler;
 
 void main() {
+    if (SHADING_MODE == 3) {
+        outColor = OVERDRAW_STEP;
+        return;
+    }
+
+    if (SHADING_MODE == 4) {
+        outColor = DENSITY_STEP;
+        return;
+    }
+
+    if (SHADING_MODE == 5) {
+        outColor = vec4(1.0);
+        return;
+    }
+
+    if (SHADING_MODE == 1) {
+        outColor = texture(texSampler, fragTexCoord);
+        return;
+    }
+
     float colorValue = max(0.01, (triangleIndex % 4) / 4.0);
     vec4 triangleColor = vec4(vec3(colorValue), 1.0f);
+    if (SHADING_MODE == 0) {
+        outColor = triangleColor;
+        return;
+    }
+
     vec4 textureColor = texture(texSampler, fragTexCoord);
     outColor = mix(triangleColor, textureColor, colorToTextureRatio);
 }
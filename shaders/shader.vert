@@ -8,14 +8,17 @@ layout(location = 1) out vec2 fragTexCoord;
 layout(location = 2) out float colorToTextureRatio;
 
 layout(binding = 0) uniform UniformBufferObject {
-    mat4 model;
-    mat4 view;
-    mat4 proj;
+    mat4 mvp;
     float colorToTextureRatio;
 } ubo;
 
+// Must match the depth pre-pass exactly for its equal depth test
+invariant gl_Position;
+
 void main() {
-    gl_Position = ubo.proj * ubo.view * ubo.model * vec4(inPosition, 1.0);
+    gl_Position = ubo.mvp * vec4(inPosition, 1.0);
+    // Only read by the point list pipeline of the density view
+    gl_PointSize = 1.0;
     triangleIndex = gl_VertexIndex / 3;
     fragTexCoord = inTexCoord;
     colorToTextureRatio = ubo.colorToTextureRatio;
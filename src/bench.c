@@ -0,0 +1,180 @@
+#include "bench.h"
+#include "timer.h"
+
+#include <math.h>
+#include <string.h>
+
+void createBenchRecorder(BenchRecorder* recorder, u32 warmupFrameCount, u32 measuredFrameCount)
+{
+    ASSERT(measuredFrameCount > 0);
+
+    *recorder = (BenchRecorder){
+        .warmupFrameCount = warmupFrameCount,
+        .measuredFrameCount = measuredFrameCount,
+        .frameTimes = mallocOrDie(measuredFrameCount * sizeof(f64)),
+        .gpuFrameTimes = mallocOrDie(measuredFrameCount * sizeof(f64))
+    };
+}
+
+void destroyBenchRecorder(BenchRecorder* recorder)
+{
+    freeAndNull(recorder->frameTimes);
+    freeAndNull(recorder->gpuFrameTimes);
+}
+
+void recordBenchFrame(BenchRecorder* recorder)
+{
+    u64 now = getTimeNanoseconds();
+    u64 frameIndex = recorder->recordedFrameCount;
+
+    // The first frame has nothing to be measured against, it only starts the
+    // clock, as do all warm-up frames
+    if (frameIndex > recorder->warmupFrameCount && !isBenchComplete(recorder))
+        recorder->frameTimes[frameIndex - recorder->warmupFrameCount - 1] = nanosecondsToSeconds(now - recorder->lastFrameTime);
+
+    recorder->lastFrameTime = now;
+    recorder->recordedFrameCount++;
+}
+
+void recordBenchGpuFrame(BenchRecorder* recorder, const GpuFrameTimings* timings)
+{
+    if (recorder->recordedFrameCount <= recorder->warmupFrameCount || isBenchComplete(recorder))
+        return;
+
+    if (timings->frameMilliseconds >= 0.0 && recorder->gpuFrameTimeCount < recorder->measuredFrameCount)
+        recorder->gpuFrameTimes[recorder->gpuFrameTimeCount++] = timings->frameMilliseconds / 1e3;
+
+    for (u32 i = 0; i < timings->passCount; i++)
+    {
+        if (timings->passMilliseconds[i] >= 0.0)
+        {
+            recorder->gpuPassSums[i] += timings->passMilliseconds[i];
+            recorder->gpuPassCounts[i]++;
+        }
+    }
+
+    if (timings->hasStatistics)
+    {
+        recorder->gpuStatisticsSum.vertexShaderInvocations += timings->statistics.vertexShaderInvocations;
+        recorder->gpuStatisticsSum.clippingPrimitives += timings->statistics.clippingPrimitives;
+        recorder->gpuStatisticsSum.fragmentShaderInvocations += timings->statistics.fragmentShaderInvocations;
+        recorder->gpuStatisticsCount++;
+    }
+}
+
+bool isBenchComplete(const BenchRecorder* recorder)
+{
+    return recorder->recordedFrameCount > recorder->warmupFrameCount + recorder->measuredFrameCount;
+}
+
+static int compareF64(const void* left, const void* right)
+{
+    f64 a = *(const f64*)left;
+    f64 b = *(const f64*)right;
+    return (a > b) - (a < b);
+}
+
+// Nearest-rank percentile of an ascending array
+static f64 getPercentile(const f64* sorted, u32 count, f64 percentile)
+{
+    u32 rank = (u32)ceil(percentile / 100.0 * count);
+    rank = (rank < 1) ? 1 : (rank > count) ? count : rank;
+    return sorted[rank - 1];
+}
+
+void writeBenchReport(const BenchRecorder* recorder, const BenchReportInfo* info, FILE* file)
+{
+    ASSERT(isBenchComplete(recorder));
+
+    u32 count = recorder->measuredFrameCount;
+    f64* sorted = mallocOrDie(count * sizeof(f64));
+    memcpy(sorted, recorder->frameTimes, count * sizeof(f64));
+    qsort(sorted, count, sizeof(f64), compareF64);
+
+    f64 totalTime = 0.0;
+    for (u32 i = 0; i < count; i++)
+        totalTime += sorted[i];
+    f64 averageTime = totalTime / count;
+
+    fprintf(file, "{\n");
+    fprintf(file, "    \"device\": ");
+    writeJsonString(file, info->deviceName);
+    fprintf(file, ",\n");
+    fprintf(file, "    \"width\": %u,\n", info->width);
+    fprintf(file, "    \"height\": %u,\n", info->height);
+    fprintf(file, "    \"headless\": %s,\n", info->headless ? "true" : "false");
+    fprintf(file, "    \"prerecord\": %s,\n", info->prerecord ? "true" : "false");
+    fprintf(file, "    \"recordThreads\": %u,\n", info->recordThreadCount);
+    fprintf(file, "    \"framesInFlight\": %u,\n", info->framesInFlight);
+    fprintf(file, "    \"presentMode\": ");
+    if (info->presentMode != NULL)
+        writeJsonString(file, info->presentMode);
+    else
+        fprintf(file, "null");
+    fprintf(file, ",\n");
+    fprintf(file, "    \"lowLatency\": %s,\n", info->lowLatency ? "true" : "false");
+    fprintf(file, "    \"depthPrepass\": %s,\n", info->depthPrepass ? "true" : "false");
+    fprintf(file, "    \"backFaceCulling\": %s,\n", info->backFaceCulling ? "true" : "false");
+    fprintf(file, "    \"dynamicRendering\": %s,\n", info->dynamicRendering ? "true" : "false");
+    fprintf(file, "    \"warmupFrames\": %u,\n", recorder->warmupFrameCount);
+    fprintf(file, "    \"frames\": %u,\n", count);
+    fprintf(file, "    \"totalSeconds\": %.6f,\n", totalTime);
+    fprintf(file, "    \"averageFrameMs\": %.4f,\n", averageTime * 1e3);
+    fprintf(file, "    \"medianFrameMs\": %.4f,\n", getPercentile(sorted, count, 50.0) * 1e3);
+    fprintf(file, "    \"p95FrameMs\": %.4f,\n", getPercentile(sorted, count, 95.0) * 1e3);
+    fprintf(file, "    \"p99FrameMs\": %.4f,\n", getPercentile(sorted, count, 99.0) * 1e3);
+    fprintf(file, "    \"minFrameMs\": %.4f,\n", sorted[0] * 1e3);
+    fprintf(file, "    \"maxFrameMs\": %.4f,\n", sorted[count - 1] * 1e3);
+    fprintf(file, "    \"framesPerSecond\": %.2f,\n", (totalTime > 0.0) ? count / totalTime : 0.0);
+    fprintf(file, "    \"trianglesPerFrame\": %llu,\n", (unsigned long long)info->trianglesPerFrame);
+    fprintf(file, "    \"trianglesPerSecond\": %.0f", (totalTime > 0.0) ? info->trianglesPerFrame * count / totalTime : 0.0);
+
+    u32 gpuCount = recorder->gpuFrameTimeCount;
+    if (gpuCount > 0)
+    {
+        memcpy(sorted, recorder->gpuFrameTimes, gpuCount * sizeof(f64));
+        qsort(sorted, gpuCount, sizeof(f64), compareF64);
+
+        f64 gpuTotalTime = 0.0;
+        for (u32 i = 0; i < gpuCount; i++)
+            gpuTotalTime += sorted[i];
+
+        fprintf(file, ",\n");
+        fprintf(file, "    \"gpuFrames\": %u,\n", gpuCount);
+        fprintf(file, "    \"gpuAverageFrameMs\": %.4f,\n", gpuTotalTime / gpuCount * 1e3);
+        fprintf(file, "    \"gpuMedianFrameMs\": %.4f,\n", getPercentile(sorted, gpuCount, 50.0) * 1e3);
+        fprintf(file, "    \"gpuP95FrameMs\": %.4f,\n", getPercentile(sorted, gpuCount, 95.0) * 1e3);
+        fprintf(file, "    \"gpuP99FrameMs\": %.4f", getPercentile(sorted, gpuCount, 99.0) * 1e3);
+
+        if (info->gpuQueries != NULL)
+        {
+            fprintf(file, ",\n    \"gpuAveragePassMs\": {");
+            const char* separator = "";
+            for (u32 i = 0; i < GPU_QUERY_MAX_PASSES; i++)
+            {
+                if (recorder->gpuPassCounts[i] == 0)
+                    continue;
+
+                fprintf(file, "%s", separator);
+                writeJsonString(file, getGpuPassName(info->gpuQueries, i));
+                fprintf(file, ": %.4f", recorder->gpuPassSums[i] / recorder->gpuPassCounts[i]);
+                separator = ", ";
+            }
+            fprintf(file, "}");
+        }
+    }
+
+    u32 statisticsCount = recorder->gpuStatisticsCount;
+    if (statisticsCount > 0)
+    {
+        const GpuPipelineStatistics* sum = &recorder->gpuStatisticsSum;
+        fprintf(file, ",\n");
+        fprintf(file, "    \"vertexShaderInvocationsPerFrame\": %.0f,\n", (f64)sum->vertexShaderInvocations / statisticsCount);
+        fprintf(file, "    \"clippingPrimitivesPerFrame\": %.0f,\n", (f64)sum->clippingPrimitives / statisticsCount);
+        fprintf(file, "    \"fragmentShaderInvocationsPerFrame\": %.0f", (f64)sum->fragmentShaderInvocations / statisticsCount);
+    }
+
+    fprintf(file, "\n}\n");
+
+    freeAndNull(sorted);
+}
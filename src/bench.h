@@ -0,0 +1,63 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "util.h"
+#include "gpu_queries.h"
+
+// Collects frame times for --bench runs. The first warmupFrameCount frames
+// are dropped so pipeline compilation and cache warm-up do not skew results.
+typedef struct
+{
+    u32 warmupFrameCount;
+    u32 measuredFrameCount;
+    u32 recordedFrameCount;
+    u64 lastFrameTime;
+    f64* frameTimes;
+
+    // GPU results arrive a few frames late and are attributed to the frame
+    // during which they were read back
+    f64* gpuFrameTimes;
+    u32 gpuFrameTimeCount;
+    f64 gpuPassSums[GPU_QUERY_MAX_PASSES];
+    u32 gpuPassCounts[GPU_QUERY_MAX_PASSES];
+    GpuPipelineStatistics gpuStatisticsSum;
+    u32 gpuStatisticsCount;
+} BenchRecorder;
+
+typedef struct
+{
+    const char* deviceName;
+    u32 width;
+    u32 height;
+    u64 trianglesPerFrame;
+    bool headless;
+    bool prerecord;
+    u32 recordThreadCount;
+    u32 framesInFlight;
+    // NULL when nothing was presented
+    const char* presentMode;
+    bool lowLatency;
+    bool depthPrepass;
+    bool backFaceCulling;
+    bool dynamicRendering;
+    // Names the GPU passes, may be NULL when no GPU timings were recorded
+    const GpuQueries* gpuQueries;
+} BenchReportInfo;
+
+void createBenchRecorder(BenchRecorder* recorder, u32 warmupFrameCount, u32 measuredFrameCount);
+void destroyBenchRecorder(BenchRecorder* recorder);
+
+// Called once per submitted frame, the time between two calls is one frame
+void recordBenchFrame(BenchRecorder* recorder);
+
+// Only timings read back during the measured frames are kept
+void recordBenchGpuFrame(BenchRecorder* recorder, const GpuFrameTimings* timings);
+
+bool isBenchComplete(const BenchRecorder* recorder);
+
+// Writes average, median, p95 and p99 frame times and triangle throughput
+// of the measured frames as a JSON object, along with GPU times and
+// pipeline statistics when there are any
+void writeBenchReport(const BenchRecorder* recorder, const BenchReportInfo* info, FILE* file);
+
+#endif
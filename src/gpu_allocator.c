@@ -0,0 +1,535 @@
+#include "gpu_allocator.h"
+
+#include <string.h>
+
+#define GPU_MEMORY_BLOCK_SIZE ((VkDeviceSize)64 * 1024 * 1024)
+#define GPU_SMALL_HEAP_SIZE ((VkDeviceSize)1024 * 1024 * 1024)
+// Share of a heap assumed to be available when the driver reports no budget,
+// the rest is left to other processes and the driver itself
+#define GPU_DEFAULT_BUDGET_PERCENT 80
+#define BYTES_PER_MIB (1024.0 * 1024.0)
+
+static const char* categoryNames[GPU_MEMORY_CATEGORY_COUNT] = {"vertex", "index", "texture", "staging", "attachment", "other"};
+
+typedef struct
+{
+    VkDeviceSize offset;
+    VkDeviceSize size;
+} FreeRange;
+
+struct GpuMemoryBlock
+{
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    u32 memoryTypeIndex;
+    bool linear;
+    // Holds exactly one allocation too large to share a block
+    bool dedicated;
+    void* mapped;
+    // Sorted by offset, adjacent ranges are always merged
+    FreeRange* freeRanges;
+    u32 freeRangeCount;
+    u32 freeRangeCapacity;
+    u32 allocationCount;
+    VkDeviceSize usedBytes;
+};
+
+struct GpuAllocator
+{
+    VkPhysicalDevice physicalDevice;
+    VkDevice device;
+    bool memoryBudgetEnabled;
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    // Per heap, indexed by heap index
+    VkDeviceSize heapBudgets[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapUsages[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapBlockBytes[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapPeakBlockBytes[VK_MAX_MEMORY_HEAPS];
+    VkDeviceSize heapCategoryBytes[VK_MAX_MEMORY_HEAPS][GPU_MEMORY_CATEGORY_COUNT];
+    VkDeviceSize bufferImageGranularity;
+    u32 maxMemoryAllocationCount;
+    GpuMemoryBlock** blocks;
+    u32 blockCount;
+    u32 blockCapacity;
+};
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (alignment > 1) ? (value + alignment - 1) / alignment * alignment : value;
+}
+
+static u32 getHeapIndex(const GpuAllocator* allocator, u32 memoryTypeIndex)
+{
+    return allocator->memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+}
+
+static VkDeviceSize getHeapUsage(const GpuAllocator* allocator, u32 heapIndex)
+{
+    return allocator->memoryBudgetEnabled ? allocator->heapUsages[heapIndex] : allocator->heapBlockBytes[heapIndex];
+}
+
+static VkDeviceSize getHeapHeadroom(const GpuAllocator* allocator, u32 heapIndex)
+{
+    VkDeviceSize usage = getHeapUsage(allocator, heapIndex);
+    return (allocator->heapBudgets[heapIndex] > usage) ? allocator->heapBudgets[heapIndex] - usage : 0;
+}
+
+static bool isMemoryTypeSuitable(const GpuAllocator* allocator, u32 memoryTypeIndex, u32 typeFilter, VkMemoryPropertyFlags properties)
+{
+    return (typeFilter & (1 << memoryTypeIndex))
+        && (allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & properties) == properties;
+}
+
+// Small heaps, such as the host visible window into device memory, get
+// smaller blocks so a single block cannot exhaust them
+static VkDeviceSize getBlockSize(const GpuAllocator* allocator, u32 memoryTypeIndex)
+{
+    u32 heapIndex = getHeapIndex(allocator, memoryTypeIndex);
+    VkDeviceSize heapSize = allocator->memoryProperties.memoryHeaps[heapIndex].size;
+    return (heapSize < GPU_SMALL_HEAP_SIZE) ? heapSize / 8 : GPU_MEMORY_BLOCK_SIZE;
+}
+
+// Allocations larger than half a block get a dedicated block of their own
+static bool isDedicatedAllocation(const GpuAllocator* allocator, u32 memoryTypeIndex, VkDeviceSize size)
+{
+    return size > getBlockSize(allocator, memoryTypeIndex) / 2;
+}
+
+// Picks the type of a new block. Types are listed roughly from fastest to
+// slowest, so the first matching type is taken unless its heap has no room
+// left for the block and a later one does.
+static u32 findMemoryType(const GpuAllocator* allocator, u32 typeFilter, VkMemoryPropertyFlags properties, VkDeviceSize size)
+{
+    u32 firstMatch = UINT32_MAX;
+    for (u32 i = 0; i < allocator->memoryProperties.memoryTypeCount; i++)
+    {
+        if (!isMemoryTypeSuitable(allocator, i, typeFilter, properties))
+            continue;
+
+        VkDeviceSize blockSize = isDedicatedAllocation(allocator, i, size) ? size : getBlockSize(allocator, i);
+        if (getHeapHeadroom(allocator, getHeapIndex(allocator, i)) >= blockSize)
+            return i;
+        if (firstMatch == UINT32_MAX)
+            firstMatch = i;
+    }
+
+    if (firstMatch == UINT32_MAX)
+        PANIC("%s\n", "Failed to find suitable memory type");
+
+    return firstMatch;
+}
+
+static void insertFreeRange(GpuMemoryBlock* block, u32 index, FreeRange range)
+{
+    if (block->freeRangeCount == block->freeRangeCapacity)
+    {
+        block->freeRangeCapacity = (block->freeRangeCapacity > 0) ? block->freeRangeCapacity * 2 : 8;
+        block->freeRanges = reallocOrDie(block->freeRanges, block->freeRangeCapacity * sizeof(FreeRange));
+    }
+
+    memmove(&block->freeRanges[index + 1], &block->freeRanges[index], (block->freeRangeCount - index) * sizeof(FreeRange));
+    block->freeRanges[index] = range;
+    block->freeRangeCount++;
+}
+
+static void removeFreeRange(GpuMemoryBlock* block, u32 index)
+{
+    memmove(&block->freeRanges[index], &block->freeRanges[index + 1], (block->freeRangeCount - index - 1) * sizeof(FreeRange));
+    block->freeRangeCount--;
+}
+
+static GpuMemoryBlock* createMemoryBlock(GpuAllocator* allocator, u32 memoryTypeIndex, VkDeviceSize size, bool linear, bool dedicated)
+{
+    if (allocator->blockCount >= allocator->maxMemoryAllocationCount)
+        PANIC("%s\n", "Exceeded maxMemoryAllocationCount");
+
+    VkMemoryAllocateInfo memoryAllocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .allocationSize = size,
+        .memoryTypeIndex = memoryTypeIndex
+    };
+
+    GpuMemoryBlock* block = mallocOrDie(sizeof(GpuMemoryBlock));
+    *block = (GpuMemoryBlock){
+        .size = size,
+        .memoryTypeIndex = memoryTypeIndex,
+        .linear = linear,
+        .dedicated = dedicated
+    };
+
+    u32 heapIndex = getHeapIndex(allocator, memoryTypeIndex);
+    if (getHeapHeadroom(allocator, heapIndex) < size)
+        INFORM("%s%u%s\n", "Allocating past the budget of memory heap ", heapIndex, ", the driver may start paging");
+
+    if (vkAllocateMemory(allocator->device, &memoryAllocateInfo, NULL, &block->memory) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to allocate device memory block");
+
+    allocator->heapBlockBytes[heapIndex] += size;
+    if (allocator->heapBlockBytes[heapIndex] > allocator->heapPeakBlockBytes[heapIndex])
+        allocator->heapPeakBlockBytes[heapIndex] = allocator->heapBlockBytes[heapIndex];
+    updateGpuMemoryBudget(allocator);
+
+    // Host visible blocks stay mapped for their whole lifetime since a memory
+    // object cannot be mapped twice by the allocations sharing it
+    if (allocator->memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+        if (vkMapMemory(allocator->device, block->memory, 0, VK_WHOLE_SIZE, 0, &block->mapped) != VK_SUCCESS)
+            PANIC("%s\n", "Failed to map device memory block");
+
+    insertFreeRange(block, 0, (FreeRange){.offset = 0, .size = size});
+
+    if (allocator->blockCount == allocator->blockCapacity)
+    {
+        allocator->blockCapacity = (allocator->blockCapacity > 0) ? allocator->blockCapacity * 2 : 8;
+        allocator->blocks = reallocOrDie(allocator->blocks, allocator->blockCapacity * sizeof(GpuMemoryBlock*));
+    }
+    allocator->blocks[allocator->blockCount++] = block;
+
+    return block;
+}
+
+static void destroyMemoryBlock(GpuAllocator* allocator, GpuMemoryBlock* block)
+{
+    for (u32 i = 0; i < allocator->blockCount; i++)
+    {
+        if (allocator->blocks[i] != block)
+            continue;
+        allocator->blocks[i] = allocator->blocks[--allocator->blockCount];
+        break;
+    }
+
+    if (block->mapped != NULL)
+        vkUnmapMemory(allocator->device, block->memory);
+    vkFreeMemory(allocator->device, block->memory, NULL);
+    allocator->heapBlockBytes[getHeapIndex(allocator, block->memoryTypeIndex)] -= block->size;
+    freeAndNull(block->freeRanges);
+    freeAndNull(block);
+
+    updateGpuMemoryBudget(allocator);
+}
+
+// First fit, the padding in front of an aligned allocation stays free
+static bool allocateFromBlock(GpuMemoryBlock* block, VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize* outOffset)
+{
+    for (u32 i = 0; i < block->freeRangeCount; i++)
+    {
+        FreeRange range = block->freeRanges[i];
+        VkDeviceSize offset = alignUp(range.offset, alignment);
+        if (offset + size > range.offset + range.size)
+            continue;
+
+        VkDeviceSize padding = offset - range.offset;
+        VkDeviceSize remaining = range.size - padding - size;
+
+        removeFreeRange(block, i);
+        if (remaining > 0)
+            insertFreeRange(block, i, (FreeRange){.offset = offset + size, .size = remaining});
+        if (padding > 0)
+            insertFreeRange(block, i, (FreeRange){.offset = range.offset, .size = padding});
+
+        block->allocationCount++;
+        block->usedBytes += size;
+        *outOffset = offset;
+        return true;
+    }
+
+    return false;
+}
+
+static void freeToBlock(GpuMemoryBlock* block, VkDeviceSize offset, VkDeviceSize size)
+{
+    u32 index = 0;
+    while (index < block->freeRangeCount && block->freeRanges[index].offset < offset)
+        index++;
+
+    insertFreeRange(block, index, (FreeRange){.offset = offset, .size = size});
+
+    FreeRange* ranges = block->freeRanges;
+    if (index + 1 < block->freeRangeCount && ranges[index].offset + ranges[index].size == ranges[index + 1].offset)
+    {
+        ranges[index].size += ranges[index + 1].size;
+        removeFreeRange(block, index + 1);
+    }
+    if (index > 0 && ranges[index - 1].offset + ranges[index - 1].size == ranges[index].offset)
+    {
+        ranges[index - 1].size += ranges[index].size;
+        removeFreeRange(block, index);
+    }
+
+    block->allocationCount--;
+    block->usedBytes -= size;
+}
+
+GpuAllocator* createGpuAllocator(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetEnabled)
+{
+    GpuAllocator* allocator = mallocOrDie(sizeof(GpuAllocator));
+    *allocator = (GpuAllocator){
+        .physicalDevice = physicalDevice,
+        .device = device,
+        .memoryBudgetEnabled = memoryBudgetEnabled
+    };
+
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &allocator->memoryProperties);
+    updateGpuMemoryBudget(allocator);
+
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+    allocator->bufferImageGranularity = physicalDeviceProperties.limits.bufferImageGranularity;
+    allocator->maxMemoryAllocationCount = physicalDeviceProperties.limits.maxMemoryAllocationCount;
+
+    return allocator;
+}
+
+void destroyGpuAllocator(GpuAllocator* allocator)
+{
+    if (allocator->blockCount > 0)
+        logGpuAllocatorStats(allocator);
+
+    while (allocator->blockCount > 0)
+        destroyMemoryBlock(allocator, allocator->blocks[allocator->blockCount - 1]);
+
+    freeAndNull(allocator->blocks);
+    freeAndNull(allocator);
+}
+
+GpuAllocation allocateGpuMemory(GpuAllocator* allocator, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, bool linear,
+    GpuMemoryCategory category)
+{
+    ASSERT(category < GPU_MEMORY_CATEGORY_COUNT);
+
+    // Linear and optimal resources live in separate blocks so neighbours
+    // never share a bufferImageGranularity page, unless the device does not
+    // care about it at all
+    if (allocator->bufferImageGranularity <= 1)
+        linear = true;
+
+    GpuMemoryBlock* block = NULL;
+    VkDeviceSize offset = 0;
+
+    // Room in an existing block costs no budget, so any suitable type will do
+    for (u32 i = 0; i < allocator->blockCount && block == NULL; i++)
+    {
+        GpuMemoryBlock* candidate = allocator->blocks[i];
+        if (!isMemoryTypeSuitable(allocator, candidate->memoryTypeIndex, requirements.memoryTypeBits, properties)
+            || candidate->linear != linear || candidate->dedicated
+            || isDedicatedAllocation(allocator, candidate->memoryTypeIndex, requirements.size))
+            continue;
+        if (allocateFromBlock(candidate, requirements.size, requirements.alignment, &offset))
+            block = candidate;
+    }
+
+    if (block == NULL)
+    {
+        u32 memoryTypeIndex = findMemoryType(allocator, requirements.memoryTypeBits, properties, requirements.size);
+        bool dedicated = isDedicatedAllocation(allocator, memoryTypeIndex, requirements.size);
+        block = createMemoryBlock(allocator, memoryTypeIndex, dedicated ? requirements.size : getBlockSize(allocator, memoryTypeIndex), linear, dedicated);
+        if (!allocateFromBlock(block, requirements.size, requirements.alignment, &offset))
+            PANIC("%s\n", "Failed to sub-allocate new memory block");
+    }
+
+    allocator->heapCategoryBytes[getHeapIndex(allocator, block->memoryTypeIndex)][category] += requirements.size;
+
+    return (GpuAllocation){
+        .block = block,
+        .memory = block->memory,
+        .offset = offset,
+        .size = requirements.size,
+        .mapped = (block->mapped != NULL) ? (u8*)block->mapped + offset : NULL,
+        .category = category
+    };
+}
+
+void freeGpuMemory(GpuAllocator* allocator, GpuAllocation* allocation)
+{
+    if (allocation->block == NULL)
+        return;
+
+    GpuMemoryBlock* block = allocation->block;
+    freeToBlock(block, allocation->offset, allocation->size);
+    allocator->heapCategoryBytes[getHeapIndex(allocator, block->memoryTypeIndex)][allocation->category] -= allocation->size;
+
+    if (block->dedicated)
+    {
+        destroyMemoryBlock(allocator, block);
+    }
+    else if (block->allocationCount == 0)
+    {
+        // One empty block per memory type and tiling kind is kept around,
+        // the next allocation of that kind is likely to need it again
+        for (u32 i = 0; i < allocator->blockCount; i++)
+        {
+            GpuMemoryBlock* other = allocator->blocks[i];
+            if (other != block && !other->dedicated && other->allocationCount == 0
+                && other->memoryTypeIndex == block->memoryTypeIndex && other->linear == block->linear)
+            {
+                destroyMemoryBlock(allocator, block);
+                break;
+            }
+        }
+    }
+
+    *allocation = (GpuAllocation){0};
+}
+
+GpuAllocation allocateAndBindBufferMemory(GpuAllocator* allocator, VkBuffer buffer, VkMemoryPropertyFlags properties, GpuMemoryCategory category)
+{
+    VkMemoryRequirements memoryRequirements;
+    vkGetBufferMemoryRequirements(allocator->device, buffer, &memoryRequirements);
+
+    GpuAllocation allocation = allocateGpuMemory(allocator, memoryRequirements, properties, true, category);
+    if (vkBindBufferMemory(allocator->device, buffer, allocation.memory, allocation.offset) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to bind buffer memory");
+
+    return allocation;
+}
+
+GpuAllocation allocateAndBindImageMemory(GpuAllocator* allocator, VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties,
+    GpuMemoryCategory category)
+{
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(allocator->device, image, &memoryRequirements);
+
+    GpuAllocation allocation = allocateGpuMemory(allocator, memoryRequirements, properties, tiling == VK_IMAGE_TILING_LINEAR, category);
+    if (vkBindImageMemory(allocator->device, image, allocation.memory, allocation.offset) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to bind image memory");
+
+    return allocation;
+}
+
+GpuAllocatorStats getGpuAllocatorStats(const GpuAllocator* allocator)
+{
+    GpuAllocatorStats stats = {.blockCount = allocator->blockCount};
+
+    for (u32 i = 0; i < allocator->blockCount; i++)
+    {
+        const GpuMemoryBlock* block = allocator->blocks[i];
+        stats.allocationCount += block->allocationCount;
+        stats.blockBytes += block->size;
+        stats.usedBytes += block->usedBytes;
+        stats.freeRangeCount += block->freeRangeCount;
+
+        VkDeviceSize blockLargestFreeRange = 0;
+        for (u32 j = 0; j < block->freeRangeCount; j++)
+            if (block->freeRanges[j].size > blockLargestFreeRange)
+                blockLargestFreeRange = block->freeRanges[j].size;
+
+        stats.contiguousFreeBytes += blockLargestFreeRange;
+        if (blockLargestFreeRange > stats.largestFreeRange)
+            stats.largestFreeRange = blockLargestFreeRange;
+    }
+
+    return stats;
+}
+
+void logGpuAllocatorStats(const GpuAllocator* allocator)
+{
+    GpuAllocatorStats stats = getGpuAllocatorStats(allocator);
+    VkDeviceSize freeBytes = stats.blockBytes - stats.usedBytes;
+
+    // Share of free memory lying outside the largest hole of its block
+    f64 fragmentation = (freeBytes > 0) ? 1.0 - (f64)stats.contiguousFreeBytes / (f64)freeBytes : 0.0;
+
+    INFORM("%s%u%s%u%s%llu%s%llu%s%u%s%.1f%s\n",
+        "GPU memory: ", stats.allocationCount, " allocations in ", stats.blockCount, " blocks, ",
+        (unsigned long long)(stats.usedBytes / 1024), " KiB used of ", (unsigned long long)(stats.blockBytes / 1024),
+        " KiB, ", stats.freeRangeCount, " free ranges, ", fragmentation * 100.0, "% fragmented");
+}
+
+void updateGpuMemoryBudget(GpuAllocator* allocator)
+{
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = &allocator->memoryProperties;
+    if (!allocator->memoryBudgetEnabled)
+    {
+        for (u32 i = 0; i < memoryProperties->memoryHeapCount; i++)
+            allocator->heapBudgets[i] = memoryProperties->memoryHeaps[i].size / 100 * GPU_DEFAULT_BUDGET_PERCENT;
+        return;
+    }
+
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT
+    };
+
+    VkPhysicalDeviceMemoryProperties2 memoryProperties2 = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2,
+        .pNext = &budgetProperties
+    };
+
+    vkGetPhysicalDeviceMemoryProperties2(allocator->physicalDevice, &memoryProperties2);
+    for (u32 i = 0; i < memoryProperties->memoryHeapCount; i++)
+    {
+        allocator->heapBudgets[i] = budgetProperties.heapBudget[i];
+        allocator->heapUsages[i] = budgetProperties.heapUsage[i];
+    }
+}
+
+u32 getGpuHeapBudgets(const GpuAllocator* allocator, GpuHeapBudget* outBudgets)
+{
+    const VkPhysicalDeviceMemoryProperties* memoryProperties = &allocator->memoryProperties;
+    for (u32 i = 0; i < memoryProperties->memoryHeapCount; i++)
+    {
+        outBudgets[i] = (GpuHeapBudget){
+            .size = memoryProperties->memoryHeaps[i].size,
+            .budget = allocator->heapBudgets[i],
+            .usage = getHeapUsage(allocator, i),
+            .deviceLocal = (memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+            .blockBytes = allocator->heapBlockBytes[i],
+            .peakBlockBytes = allocator->heapPeakBlockBytes[i]
+        };
+        memcpy(outBudgets[i].categoryBytes, allocator->heapCategoryBytes[i], sizeof(outBudgets[i].categoryBytes));
+    }
+
+    return memoryProperties->memoryHeapCount;
+}
+
+VkDeviceSize getGpuMemoryHeadroom(const GpuAllocator* allocator, VkMemoryPropertyFlags properties, u32* outHeapIndex)
+{
+    u32 heapIndex = getHeapIndex(allocator, findMemoryType(allocator, UINT32_MAX, properties, 0));
+    if (outHeapIndex != NULL)
+        *outHeapIndex = heapIndex;
+
+    return getHeapHeadroom(allocator, heapIndex);
+}
+
+void formatGpuMemoryUsage(const GpuAllocator* allocator, char* buffer, usize bufferSize)
+{
+    GpuHeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+    u32 heapCount = getGpuHeapBudgets(allocator, budgets);
+
+    const GpuHeapBudget* fullest = NULL;
+    for (u32 i = 0; i < heapCount; i++)
+    {
+        if (!budgets[i].deviceLocal || budgets[i].budget == 0)
+            continue;
+        if (fullest == NULL || (f64)budgets[i].usage / budgets[i].budget > (f64)fullest->usage / fullest->budget)
+            fullest = &budgets[i];
+    }
+
+    if (fullest == NULL)
+    {
+        buffer[0] = '\0';
+        return;
+    }
+
+    snprintf(buffer, bufferSize, "vram %.0f/%.0f MiB", fullest->usage / BYTES_PER_MIB, fullest->budget / BYTES_PER_MIB);
+}
+
+void writeGpuMemoryReport(const GpuAllocator* allocator, FILE* stream)
+{
+    GpuHeapBudget budgets[VK_MAX_MEMORY_HEAPS];
+    u32 heapCount = getGpuHeapBudgets(allocator, budgets);
+
+    fprintf(stream, "GPU memory (%s):\n", allocator->memoryBudgetEnabled ? "driver budget" : "estimated budget");
+    for (u32 i = 0; i < heapCount; i++)
+    {
+        const GpuHeapBudget* budget = &budgets[i];
+        if (budget->peakBlockBytes == 0 && !budget->deviceLocal)
+            continue;
+
+        fprintf(stream, "    heap %u%s: %.1f of %.1f MiB budget, %.1f MiB heap, blocks %.1f MiB, peak %.1f MiB\n", i,
+            budget->deviceLocal ? " (device local)" : "", budget->usage / BYTES_PER_MIB, budget->budget / BYTES_PER_MIB,
+            budget->size / BYTES_PER_MIB, budget->blockBytes / BYTES_PER_MIB, budget->peakBlockBytes / BYTES_PER_MIB);
+
+        fprintf(stream, "       ");
+        for (u32 j = 0; j < GPU_MEMORY_CATEGORY_COUNT; j++)
+            fprintf(stream, " %s %.1f MiB%s", categoryNames[j], budget->categoryBytes[j] / BYTES_PER_MIB, (j + 1 < GPU_MEMORY_CATEGORY_COUNT) ? "," : "\n");
+    }
+}
@@ -0,0 +1,105 @@
+#ifndef GPU_ALLOCATOR_H
+#define GPU_ALLOCATOR_H
+
+#include "util.h"
+
+#include <stdio.h>
+#include <vulkan/vulkan.h>
+
+typedef struct GpuAllocator GpuAllocator;
+typedef struct GpuMemoryBlock GpuMemoryBlock;
+
+// What an allocation is used for, only for accounting
+typedef enum
+{
+    GPU_MEMORY_CATEGORY_VERTEX,
+    GPU_MEMORY_CATEGORY_INDEX,
+    GPU_MEMORY_CATEGORY_TEXTURE,
+    GPU_MEMORY_CATEGORY_STAGING,
+    GPU_MEMORY_CATEGORY_ATTACHMENT,
+    // Uniform and readback buffers
+    GPU_MEMORY_CATEGORY_OTHER,
+    GPU_MEMORY_CATEGORY_COUNT
+} GpuMemoryCategory;
+
+// A range sub-allocated from one of the allocator's device memory blocks.
+// mapped points at offset inside the persistently mapped block when the
+// memory is host visible and is NULL otherwise.
+typedef struct
+{
+    GpuMemoryBlock* block;
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* mapped;
+    GpuMemoryCategory category;
+} GpuAllocation;
+
+typedef struct
+{
+    u32 blockCount;
+    u32 allocationCount;
+    VkDeviceSize blockBytes;
+    VkDeviceSize usedBytes;
+    u32 freeRangeCount;
+    VkDeviceSize largestFreeRange;
+    // Sum of the largest free range of every block, the free memory that is
+    // not split up by live allocations
+    VkDeviceSize contiguousFreeBytes;
+} GpuAllocatorStats;
+
+// Usage of one memory heap. With VK_EXT_memory_budget, budget and usage are
+// reported by the driver and usage includes other allocations of the
+// process. Without it budget is a fixed share of the heap size and usage is
+// what this allocator holds.
+typedef struct
+{
+    VkDeviceSize size;
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    bool deviceLocal;
+    // Memory blocks of this allocator, free ranges included
+    VkDeviceSize blockBytes;
+    VkDeviceSize peakBlockBytes;
+    VkDeviceSize categoryBytes[GPU_MEMORY_CATEGORY_COUNT];
+} GpuHeapBudget;
+
+// Not thread safe, all calls are expected to come from the same thread.
+// memoryBudgetEnabled tells whether the device was created with
+// VK_EXT_memory_budget.
+GpuAllocator* createGpuAllocator(VkPhysicalDevice physicalDevice, VkDevice device, bool memoryBudgetEnabled);
+void destroyGpuAllocator(GpuAllocator* allocator);
+
+// Linear resources are buffers and linear tiling images, optimal tiling
+// images must pass false so bufferImageGranularity can be honored
+GpuAllocation allocateGpuMemory(GpuAllocator* allocator, VkMemoryRequirements requirements, VkMemoryPropertyFlags properties, bool linear,
+    GpuMemoryCategory category);
+void freeGpuMemory(GpuAllocator* allocator, GpuAllocation* allocation);
+
+GpuAllocation allocateAndBindBufferMemory(GpuAllocator* allocator, VkBuffer buffer, VkMemoryPropertyFlags properties, GpuMemoryCategory category);
+GpuAllocation allocateAndBindImageMemory(GpuAllocator* allocator, VkImage image, VkImageTiling tiling, VkMemoryPropertyFlags properties,
+    GpuMemoryCategory category);
+
+GpuAllocatorStats getGpuAllocatorStats(const GpuAllocator* allocator);
+void logGpuAllocatorStats(const GpuAllocator* allocator);
+
+// Queries the driver for the current budgets, which change as other
+// processes allocate. Allocating a new block updates them as well.
+void updateGpuMemoryBudget(GpuAllocator* allocator);
+// Returns the heap count
+u32 getGpuHeapBudgets(const GpuAllocator* allocator, GpuHeapBudget* outBudgets);
+
+// Bytes that can still be allocated with properties before the heap they
+// come from goes over budget. This is an estimate: it assumes the first
+// memory type with properties, while a resource's own memory requirements
+// may restrict it to a type on another heap, and it ignores free space left
+// in existing blocks.
+VkDeviceSize getGpuMemoryHeadroom(const GpuAllocator* allocator, VkMemoryPropertyFlags properties, u32* outHeapIndex);
+
+// Formats the fullest device local heap as a single line such as
+// "vram 512/7680 MiB", empty when the device has none
+void formatGpuMemoryUsage(const GpuAllocator* allocator, char* buffer, usize bufferSize);
+// Usage, peak and per category breakdown of every heap the allocator used
+void writeGpuMemoryReport(const GpuAllocator* allocator, FILE* stream);
+
+#endif
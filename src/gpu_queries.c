@@ -0,0 +1,341 @@
+#include "gpu_queries.h"
+
+#include <string.h>
+
+#define GPU_PIPELINE_STATISTIC_FLAGS (VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT \
+    | VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT | VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT)
+#define GPU_PIPELINE_STATISTIC_COUNT 3
+
+struct GpuQueries
+{
+    VkDevice device;
+    u32 frameSlotCount;
+    u32 passCount;
+    const char* passNames[GPU_QUERY_MAX_PASSES];
+
+    // Begin and end timestamp of every pass, per frame slot
+    VkQueryPool timestampPool;
+    f64 timestampPeriod;
+    u64 timestampMask;
+
+    // One query per frame slot
+    VkQueryPool statisticsPool;
+
+    bool* submitted;
+};
+
+GpuQueries* createGpuQueries(VkPhysicalDevice physicalDevice, VkDevice device, u32 queueFamilyIndex, bool pipelineStatisticsEnabled,
+    u32 frameSlotCount, u32 passCount, const char* const* passNames)
+{
+    ASSERT(passCount > 0 && passCount <= GPU_QUERY_MAX_PASSES);
+
+    GpuQueries* queries = mallocOrDie(sizeof(GpuQueries));
+    *queries = (GpuQueries){
+        .device = device,
+        .frameSlotCount = frameSlotCount,
+        .passCount = passCount,
+        .submitted = mallocOrDie(frameSlotCount * sizeof(bool))
+    };
+
+    for (u32 i = 0; i < passCount; i++)
+        queries->passNames[i] = passNames[i];
+    for (u32 i = 0; i < frameSlotCount; i++)
+        queries->submitted[i] = false;
+
+    u32 queueFamilyPropertiesCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, NULL);
+    VkQueueFamilyProperties* queueFamilyProperties = mallocOrDie(sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, queueFamilyProperties);
+    ASSERT(queueFamilyIndex < queueFamilyPropertiesCount);
+    u32 timestampValidBits = queueFamilyProperties[queueFamilyIndex].timestampValidBits;
+    freeAndNull(queueFamilyProperties);
+
+    VkPhysicalDeviceProperties physicalDeviceProperties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+    if (timestampValidBits > 0)
+    {
+        queries->timestampPeriod = physicalDeviceProperties.limits.timestampPeriod;
+        queries->timestampMask = (timestampValidBits >= 64) ? UINT64_MAX : (1ull << timestampValidBits) - 1;
+
+        VkQueryPoolCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_TIMESTAMP,
+            .queryCount = frameSlotCount * passCount * 2
+        };
+
+        if (vkCreateQueryPool(device, &createInfo, NULL, &queries->timestampPool) != VK_SUCCESS)
+            PANIC("%s\n", "Failed to create timestamp query pool");
+    }
+    else
+    {
+        INFORM("%s\n", "Queue family does not support timestamps, GPU timings are disabled");
+    }
+
+    if (pipelineStatisticsEnabled)
+    {
+        VkQueryPoolCreateInfo createInfo = {
+            .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+            .queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+            .queryCount = frameSlotCount,
+            .pipelineStatistics = GPU_PIPELINE_STATISTIC_FLAGS
+        };
+
+        if (vkCreateQueryPool(device, &createInfo, NULL, &queries->statisticsPool) != VK_SUCCESS)
+            PANIC("%s\n", "Failed to create pipeline statistics query pool");
+    }
+
+    return queries;
+}
+
+void destroyGpuQueries(GpuQueries* queries)
+{
+    if (queries == NULL)
+        return;
+
+    if (queries->timestampPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(queries->device, queries->timestampPool, NULL);
+    if (queries->statisticsPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(queries->device, queries->statisticsPool, NULL);
+
+    freeAndNull(queries->submitted);
+    free(queries);
+}
+
+const char* getGpuPassName(const GpuQueries* queries, u32 pass)
+{
+    ASSERT(pass < queries->passCount);
+    return queries->passNames[pass];
+}
+
+VkQueryPipelineStatisticFlags getGpuPipelineStatisticFlags(const GpuQueries* queries)
+{
+    return (queries->statisticsPool != VK_NULL_HANDLE) ? GPU_PIPELINE_STATISTIC_FLAGS : 0;
+}
+
+static u32 getTimestampQuery(const GpuQueries* queries, u32 slot, u32 pass, bool end)
+{
+    ASSERT(slot < queries->frameSlotCount && pass < queries->passCount);
+    return (slot * queries->passCount + pass) * 2 + (end ? 1 : 0);
+}
+
+void resetGpuQueries(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot)
+{
+    if (queries->timestampPool != VK_NULL_HANDLE)
+        vkCmdResetQueryPool(commandBuffer, queries->timestampPool, getTimestampQuery(queries, slot, 0, false), queries->passCount * 2);
+    if (queries->statisticsPool != VK_NULL_HANDLE)
+        vkCmdResetQueryPool(commandBuffer, queries->statisticsPool, slot, 1);
+}
+
+void beginGpuPass(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot, u32 pass)
+{
+    if (queries->timestampPool != VK_NULL_HANDLE)
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queries->timestampPool, getTimestampQuery(queries, slot, pass, false));
+}
+
+void endGpuPass(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot, u32 pass)
+{
+    if (queries->timestampPool != VK_NULL_HANDLE)
+        vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queries->timestampPool, getTimestampQuery(queries, slot, pass, true));
+}
+
+void beginGpuPipelineStatistics(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot)
+{
+    if (queries->statisticsPool != VK_NULL_HANDLE)
+        vkCmdBeginQuery(commandBuffer, queries->statisticsPool, slot, 0);
+}
+
+void endGpuPipelineStatistics(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot)
+{
+    if (queries->statisticsPool != VK_NULL_HANDLE)
+        vkCmdEndQuery(commandBuffer, queries->statisticsPool, slot);
+}
+
+void markGpuQueriesSubmitted(GpuQueries* queries, u32 slot)
+{
+    ASSERT(slot < queries->frameSlotCount);
+    queries->submitted[slot] = true;
+}
+
+bool readGpuFrameTimings(GpuQueries* queries, u32 slot, GpuFrameTimings* outTimings)
+{
+    ASSERT(slot < queries->frameSlotCount);
+    if (!queries->submitted[slot])
+        return false;
+
+    // Skipped frames leave the slot without a new submission, whose results
+    // must not be read a second time
+    queries->submitted[slot] = false;
+
+    *outTimings = (GpuFrameTimings){
+        .passCount = queries->passCount,
+        .frameMilliseconds = -1.0
+    };
+
+    for (u32 i = 0; i < queries->passCount; i++)
+        outTimings->passMilliseconds[i] = -1.0;
+
+    // Each result is followed by its availability, passes not recorded this
+    // frame were reset but never written and stay unavailable
+    if (queries->timestampPool != VK_NULL_HANDLE)
+    {
+        u64 results[GPU_QUERY_MAX_PASSES * 2][2];
+        VkResult result = vkGetQueryPoolResults(queries->device, queries->timestampPool, getTimestampQuery(queries, slot, 0, false), queries->passCount * 2,
+            sizeof(results), results, sizeof(results[0]), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result != VK_SUCCESS && result != VK_NOT_READY)
+            PANIC("%s\n", "Failed to read timestamp query results");
+
+        u64 frameBegin = UINT64_MAX;
+        u64 frameEnd = 0;
+        for (u32 i = 0; i < queries->passCount; i++)
+        {
+            if (results[i * 2][1] == 0 || results[i * 2 + 1][1] == 0)
+                continue;
+
+            u64 begin = results[i * 2][0] & queries->timestampMask;
+            u64 end = results[i * 2 + 1][0] & queries->timestampMask;
+            outTimings->passMilliseconds[i] = ((end - begin) & queries->timestampMask) * queries->timestampPeriod / 1e6;
+
+            frameBegin = (begin < frameBegin) ? begin : frameBegin;
+            frameEnd = (end > frameEnd) ? end : frameEnd;
+        }
+
+        if (frameBegin <= frameEnd)
+            outTimings->frameMilliseconds = (frameEnd - frameBegin) * queries->timestampPeriod / 1e6;
+    }
+
+    if (queries->statisticsPool != VK_NULL_HANDLE)
+    {
+        // Statistics come in flag bit order followed by the availability
+        u64 results[GPU_PIPELINE_STATISTIC_COUNT + 1];
+        VkResult result = vkGetQueryPoolResults(queries->device, queries->statisticsPool, slot, 1,
+            sizeof(results), results, sizeof(results), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+        if (result != VK_SUCCESS && result != VK_NOT_READY)
+            PANIC("%s\n", "Failed to read pipeline statistics query results");
+
+        if (results[GPU_PIPELINE_STATISTIC_COUNT] != 0)
+        {
+            outTimings->hasStatistics = true;
+            outTimings->statistics = (GpuPipelineStatistics){
+                .vertexShaderInvocations = results[0],
+                .clippingPrimitives = results[1],
+                .fragmentShaderInvocations = results[2]
+            };
+        }
+    }
+
+    return true;
+}
+
+static void formatCount(f64 count, char* buffer, usize bufferSize)
+{
+    if (count >= 1e9)
+        snprintf(buffer, bufferSize, "%.2fG", count / 1e9);
+    else if (count >= 1e6)
+        snprintf(buffer, bufferSize, "%.2fM", count / 1e6);
+    else if (count >= 1e3)
+        snprintf(buffer, bufferSize, "%.1fk", count / 1e3);
+    else
+        snprintf(buffer, bufferSize, "%.0f", count);
+}
+
+void formatGpuFrameTimings(const GpuQueries* queries, const GpuFrameTimings* timings, char* buffer, usize bufferSize)
+{
+    ASSERT(bufferSize > 0);
+    buffer[0] = '\0';
+    usize length = 0;
+
+#define APPEND(...) \
+    do { if (length < bufferSize) length += snprintf(buffer + length, bufferSize - length, __VA_ARGS__); } while (0)
+
+    if (timings->frameMilliseconds >= 0.0)
+    {
+        APPEND("gpu %.2f ms", timings->frameMilliseconds);
+
+        // Per pass times only add information once there is more than one
+        const char* separator = " (";
+        for (u32 i = 0; i < timings->passCount && timings->passCount > 1; i++)
+        {
+            if (timings->passMilliseconds[i] < 0.0)
+                continue;
+
+            APPEND("%s%s %.2f", separator, queries->passNames[i], timings->passMilliseconds[i]);
+            separator = ", ";
+        }
+        if (separator[0] == ',')
+            APPEND(")");
+    }
+
+    if (timings->hasStatistics)
+    {
+        char vertices[16], primitives[16], fragments[16];
+        formatCount((f64)timings->statistics.vertexShaderInvocations, vertices, sizeof(vertices));
+        formatCount((f64)timings->statistics.clippingPrimitives, primitives, sizeof(primitives));
+        formatCount((f64)timings->statistics.fragmentShaderInvocations, fragments, sizeof(fragments));
+        APPEND("%svs %s | prims %s | fs %s", (length > 0) ? " | " : "", vertices, primitives, fragments);
+    }
+
+#undef APPEND
+}
+
+void averageGpuFrameTimings(const GpuFrameTimings* timings, u32 count, GpuFrameTimings* outAverage)
+{
+    *outAverage = (GpuFrameTimings){.frameMilliseconds = -1.0};
+    for (u32 i = 0; i < GPU_QUERY_MAX_PASSES; i++)
+        outAverage->passMilliseconds[i] = -1.0;
+
+    if (count == 0)
+        return;
+
+    outAverage->passCount = timings[0].passCount;
+
+    f64 passSums[GPU_QUERY_MAX_PASSES] = {0};
+    u32 passCounts[GPU_QUERY_MAX_PASSES] = {0};
+    f64 frameSum = 0.0;
+    u32 frameCount = 0;
+    f64 statisticsSums[GPU_PIPELINE_STATISTIC_COUNT] = {0};
+    u32 statisticsCount = 0;
+
+    for (u32 i = 0; i < count; i++)
+    {
+        for (u32 j = 0; j < timings[i].passCount; j++)
+        {
+            if (timings[i].passMilliseconds[j] >= 0.0)
+            {
+                passSums[j] += timings[i].passMilliseconds[j];
+                passCounts[j]++;
+            }
+        }
+
+        if (timings[i].frameMilliseconds >= 0.0)
+        {
+            frameSum += timings[i].frameMilliseconds;
+            frameCount++;
+        }
+
+        if (timings[i].hasStatistics)
+        {
+            statisticsSums[0] += (f64)timings[i].statistics.vertexShaderInvocations;
+            statisticsSums[1] += (f64)timings[i].statistics.clippingPrimitives;
+            statisticsSums[2] += (f64)timings[i].statistics.fragmentShaderInvocations;
+            statisticsCount++;
+        }
+    }
+
+    for (u32 i = 0; i < outAverage->passCount; i++)
+        if (passCounts[i] > 0)
+            outAverage->passMilliseconds[i] = passSums[i] / passCounts[i];
+
+    if (frameCount > 0)
+        outAverage->frameMilliseconds = frameSum / frameCount;
+
+    if (statisticsCount > 0)
+    {
+        outAverage->hasStatistics = true;
+        outAverage->statistics = (GpuPipelineStatistics){
+            .vertexShaderInvocations = (u64)(statisticsSums[0] / statisticsCount + 0.5),
+            .clippingPrimitives = (u64)(statisticsSums[1] / statisticsCount + 0.5),
+            .fragmentShaderInvocations = (u64)(statisticsSums[2] / statisticsCount + 0.5)
+        };
+    }
+}
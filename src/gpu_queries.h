@@ -0,0 +1,70 @@
+#ifndef GPU_QUERIES_H
+#define GPU_QUERIES_H
+
+#include "util.h"
+
+#include <vulkan/vulkan.h>
+
+#define GPU_QUERY_MAX_PASSES 4
+
+typedef struct
+{
+    u64 vertexShaderInvocations;
+    u64 clippingPrimitives;
+    u64 fragmentShaderInvocations;
+} GpuPipelineStatistics;
+
+// Results of one frame. A pass that was not recorded that frame has a
+// negative time.
+typedef struct
+{
+    u32 passCount;
+    f64 passMilliseconds[GPU_QUERY_MAX_PASSES];
+    // From the start of the first to the end of the last recorded pass
+    f64 frameMilliseconds;
+    bool hasStatistics;
+    GpuPipelineStatistics statistics;
+} GpuFrameTimings;
+
+// Timestamp and pipeline statistics query pools, one set per frame slot so
+// results are read back only after that slot's last submission has completed
+// and the CPU never waits on them
+typedef struct GpuQueries GpuQueries;
+
+// Timestamps are left out when the queue family does not support them,
+// pipeline statistics when the device feature was not enabled
+GpuQueries* createGpuQueries(VkPhysicalDevice physicalDevice, VkDevice device, u32 queueFamilyIndex, bool pipelineStatisticsEnabled,
+    u32 frameSlotCount, u32 passCount, const char* const* passNames);
+void destroyGpuQueries(GpuQueries* queries);
+
+const char* getGpuPassName(const GpuQueries* queries, u32 pass);
+
+// Flags secondary command buffers executed inside the statistics query have
+// to inherit, 0 when statistics are disabled
+VkQueryPipelineStatisticFlags getGpuPipelineStatisticFlags(const GpuQueries* queries);
+
+// Recorded at the start of the slot's command buffer, outside any render pass
+void resetGpuQueries(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot);
+
+void beginGpuPass(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot, u32 pass);
+void endGpuPass(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot, u32 pass);
+
+void beginGpuPipelineStatistics(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot);
+void endGpuPipelineStatistics(GpuQueries* queries, VkCommandBuffer commandBuffer, u32 slot);
+
+// Called whenever a command buffer with the slot's queries is submitted
+void markGpuQueriesSubmitted(GpuQueries* queries, u32 slot);
+
+// Reads the results of the last submission of the slot. Returns false if
+// there are none yet or they have already been read. Must only be called
+// once the slot's last submission has completed.
+bool readGpuFrameTimings(GpuQueries* queries, u32 slot, GpuFrameTimings* outTimings);
+
+// Formats timings as a single line such as "gpu 1.23 ms | vs 12.3k | prims 4.0k | fs 2.50M"
+void formatGpuFrameTimings(const GpuQueries* queries, const GpuFrameTimings* timings, char* buffer, usize bufferSize);
+
+// Averages a list of frame timings, passes and statistics missing from some
+// frames are averaged over the frames that have them
+void averageGpuFrameTimings(const GpuFrameTimings* timings, u32 count, GpuFrameTimings* outAverage);
+
+#endif
@@ -0,0 +1,93 @@
+#include "gpu_timeline.h"
+
+bool isGpuTimelineSupported(VkPhysicalDevice physicalDevice, u32 instanceApiVersion)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (instanceApiVersion < VK_API_VERSION_1_2 || properties.apiVersion < VK_API_VERSION_1_2)
+        return false;
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES
+    };
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &vulkan12Features
+    };
+
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+    return vulkan12Features.timelineSemaphore;
+}
+
+void createGpuTimeline(VkDevice device, GpuTimeline* outTimeline)
+{
+    *outTimeline = (GpuTimeline){
+        .device = device,
+        .waitSemaphores = (PFN_vkWaitSemaphores)vkGetDeviceProcAddr(device, "vkWaitSemaphores"),
+        .getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValue)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValue")
+    };
+
+    if (outTimeline->waitSemaphores == NULL || outTimeline->getSemaphoreCounterValue == NULL)
+        PANIC("%s\n", "Failed to load timeline semaphore functions");
+
+    VkSemaphoreTypeCreateInfo semaphoreTypeCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = 0
+    };
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &semaphoreTypeCreateInfo
+    };
+
+    if (vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &outTimeline->semaphore) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to create timeline semaphore");
+}
+
+void destroyGpuTimeline(GpuTimeline* timeline)
+{
+    vkDestroySemaphore(timeline->device, timeline->semaphore, NULL);
+    timeline->semaphore = VK_NULL_HANDLE;
+}
+
+u64 advanceGpuTimeline(GpuTimeline* timeline)
+{
+    return ++timeline->submittedValue;
+}
+
+bool isGpuTimelineValueComplete(GpuTimeline* timeline, u64 value)
+{
+    ASSERT(value <= timeline->submittedValue);
+
+    if (value <= timeline->completedValue)
+        return true;
+
+    u64 counterValue;
+    if (timeline->getSemaphoreCounterValue(timeline->device, timeline->semaphore, &counterValue) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to query timeline semaphore value");
+
+    timeline->completedValue = (counterValue > timeline->completedValue) ? counterValue : timeline->completedValue;
+    return value <= timeline->completedValue;
+}
+
+void waitForGpuTimelineValue(GpuTimeline* timeline, u64 value)
+{
+    ASSERT(value <= timeline->submittedValue);
+
+    if (value <= timeline->completedValue)
+        return;
+
+    VkSemaphoreWaitInfo waitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .semaphoreCount = 1,
+        .pSemaphores = &timeline->semaphore,
+        .pValues = &value
+    };
+
+    if (timeline->waitSemaphores(timeline->device, &waitInfo, UINT64_MAX) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to wait for timeline semaphore");
+
+    timeline->completedValue = value;
+}
@@ -0,0 +1,40 @@
+#ifndef GPU_TIMELINE_H
+#define GPU_TIMELINE_H
+
+#include "util.h"
+
+#include <vulkan/vulkan.h>
+
+// A single timeline semaphore that every graphics queue submission signals
+// with the next value. Work is identified by the value its submission
+// signals and is complete once the semaphore's counter has reached it, so
+// anything it used can be recycled without fences or queue idles.
+typedef struct
+{
+    VkDevice device;
+    VkSemaphore semaphore;
+    PFN_vkWaitSemaphores waitSemaphores;
+    PFN_vkGetSemaphoreCounterValue getSemaphoreCounterValue;
+    // Value of the latest submission
+    u64 submittedValue;
+    // Counter value last read from the device, only ever grows
+    u64 completedValue;
+} GpuTimeline;
+
+// Timeline semaphores are core in Vulkan 1.2, which the instance has to have
+// been created with as well
+bool isGpuTimelineSupported(VkPhysicalDevice physicalDevice, u32 instanceApiVersion);
+
+// The device must have been created with the timelineSemaphore feature
+void createGpuTimeline(VkDevice device, GpuTimeline* outTimeline);
+void destroyGpuTimeline(GpuTimeline* timeline);
+
+// Returns the value the next submission has to signal. Submissions signaling
+// the timeline must go to the same queue in the order of their values.
+u64 advanceGpuTimeline(GpuTimeline* timeline);
+
+// Polls the device without blocking
+bool isGpuTimelineValueComplete(GpuTimeline* timeline, u64 value);
+void waitForGpuTimelineValue(GpuTimeline* timeline, u64 value);
+
+#endif
@@ -3,11 +3,25 @@
 #include "util.h"
 #include "maths.h"
 #include "obj_parser.h"
+#include "pipeline_cache.h"
+#include "worker_pool.h"
+#include "gpu_allocator.h"
+#include "texture_file.h"
+#include "timer.h"
+#include "bench.h"
+#include "gpu_queries.h"
+#include "gpu_timeline.h"
+#include "profiler.h"
+#include "resolution_scaler.h"
+#include "mesh_winding.h"
 #include "texture_data.h"
+#include "shader.vert.spv.h"
+#include "shader.frag.spv.h"
+#include "depth.vert.spv.h"
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <time.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include "GLFW/glfw3.h"
@@ -16,19 +30,123 @@
 #define WINDOW_WIDTH 1280
 #define WINDOW_HEIGHT 720
 
-#define MAX_FRAMES_IN_FLIGHT 2
+#define MAX_FRAMES_IN_FLIGHT 4
+#define DEFAULT_FRAMES_IN_FLIGHT 2
+#define OFFSCREEN_COLOR_FORMAT VK_FORMAT_R8G8B8A8_SRGB
+#define FIXED_FRAME_TIME (1.0f / 60.0f)
+#define BENCH_WARMUP_FRAME_COUNT 60
+#define GPU_TIMING_HISTORY_SIZE 64
+#define GPU_TIMING_READOUT_INTERVAL 0.5
+#define MAX_RECORD_THREADS 16
+#define MIN_RENDER_SCALE 0.5f
+#define DRAW_CHUNK_TRIANGLE_COUNT 4096
 
-static Vertex* g_vertices = NULL;
-static u32 g_vertexCount = 0;
+typedef struct
+{
+    Vertex* vertices;
+    u32 vertexCount;
+    Index* indices;
+    u32 indexCount;
+    // Whether back faces can be culled
+    bool closed;
+} Model;
+
+// The model whose mesh is currently drawn
+static Model g_model = {0};
+
+// Contiguous slices of the index buffer, the unit of work handed to the
+// recording threads
+typedef struct
+{
+    u32 firstIndex;
+    u32 indexCount;
+} DrawCommand;
 
-static u32* g_indices = NULL;
-static u32 g_indexCount = 0;
+static DrawCommand* g_drawCommands = NULL;
+static u32 g_drawCommandCount = 0;
 
 static f32 g_modelX = 0.0f;
 static f32 g_modelY = 0.0f;
 static f32 g_modelZ = 0.0f;
 
+typedef struct
+{
+    Vec3 eye;
+    Vec3 target;
+    Vec3 up;
+    f32 fov;
+    VkExtent2D extent;
+    Mat4 viewProj;
+    bool dirty;
+} Camera;
+
+static Camera g_camera = {
+    .eye = {0.0f, 0.0f, 2.0f},
+    .target = {0.0f, 0.0f, 0.0f},
+    .up = {0.0f, 1.0f, 0.0f},
+    .fov = 45.0f,
+    .dirty = true
+};
+
+// Fragment shader variants selected through the SHADING_MODE specialization
+// constant in shader.frag, so steady-state frames skip the unused half. The
+// debug modes also change fixed-function state, see createGraphicsPipelines.
+typedef enum
+{
+    SHADING_MODE_COLOR,
+    SHADING_MODE_TEXTURE,
+    SHADING_MODE_BLEND,
+    SHADING_MODE_OVERDRAW,
+    SHADING_MODE_DENSITY,
+    SHADING_MODE_WIREFRAME,
+    SHADING_MODE_COUNT
+} ShadingMode;
+
+// Every pipeline exists with and without back-face culling. Culling is only
+// used for meshes that orientMeshWinding found to be closed.
+typedef enum
+{
+    CULL_VARIANT_NONE,
+    CULL_VARIANT_BACK,
+    CULL_VARIANT_COUNT
+} CullVariant;
+
+// Cycled with V, each view draws the scene with one of the debug shading
+// modes instead of the regular ones
+typedef enum
+{
+    DEBUG_VIEW_NONE,
+    DEBUG_VIEW_OVERDRAW,
+    DEBUG_VIEW_DENSITY,
+    DEBUG_VIEW_WIREFRAME,
+    DEBUG_VIEW_COUNT
+} DebugView;
+
+static const char* debugViewNames[DEBUG_VIEW_COUNT] = {"shaded", "overdraw", "density", "wireframe"};
+
+// Passes timed with GPU timestamps, new passes get a slot here
+typedef enum
+{
+    GPU_PASS_SCENE,
+    GPU_PASS_UPSCALE,
+    GPU_PASS_DEPTH_PREPASS,
+    GPU_PASS_COUNT
+} GpuPass;
+
+static const char* gpuPassNames[GPU_PASS_COUNT] = {"scene", "upscale", "depth prepass"};
+
 static bool g_showTexture = false;
+static DebugView g_debugView = DEBUG_VIEW_NONE;
+static bool g_rotationPaused = false;
+static bool g_redrawRequested = false;
+static bool g_reloadRequested = false;
+static bool g_profilerDumpRequested = false;
+static const char* g_profilerTracePath = NULL;
+
+// Vulkan 1.3 commands, only loaded for the dynamic rendering path
+static PFN_vkCmdBeginRendering g_vkCmdBeginRendering = NULL;
+static PFN_vkCmdEndRendering g_vkCmdEndRendering = NULL;
+static PFN_vkCmdPipelineBarrier2 g_vkCmdPipelineBarrier2 = NULL;
 static f32 g_colorToTextureRatio = 0.0f;
 static f32 g_colorToTextureTransitionRate = 0.01f;
 
@@ -47,6 +165,7 @@ static const char* instanceExtensionNames[] = {
 };
 static u32 instanceExtensionCount = ARR_LEN(instanceExtensionNames);
 
+// VK_KHR_swapchain has to stay last, headless runs leave it out
 static const char* deviceExtensionNames[] = {
 #ifdef APPLE
     "VK_KHR_portability_subset",
@@ -55,7 +174,34 @@ static const char* deviceExtensionNames[] = {
 };
 static u32 deviceExtensionCount = ARR_LEN(deviceExtensionNames);
 
-static void normalizeAndCenterModel()
+typedef struct
+{
+    const char* name;
+    VkPresentModeKHR mode;
+} PresentModeName;
+
+static const PresentModeName presentModeNames[] = {
+    {"fifo", VK_PRESENT_MODE_FIFO_KHR},
+    {"fifo_relaxed", VK_PRESENT_MODE_FIFO_RELAXED_KHR},
+    {"mailbox", VK_PRESENT_MODE_MAILBOX_KHR},
+    {"immediate", VK_PRESENT_MODE_IMMEDIATE_KHR}
+};
+
+static const char* getPresentModeName(VkPresentModeKHR mode)
+{
+    for (u32 i = 0; i < ARR_LEN(presentModeNames); i++)
+        if (presentModeNames[i].mode == mode)
+            return presentModeNames[i].name;
+
+    return "unknown";
+}
+
+static u32 getDeviceExtensionCount(bool headless)
+{
+    return headless ? deviceExtensionCount - 1 : deviceExtensionCount;
+}
+
+static void normalizeAndCenterModel(Model* model)
 {
     f32 vertexMinX = FLT_MAX;
     f32 vertexMinY = FLT_MAX;
@@ -63,14 +209,14 @@ static void normalizeAndCenterModel()
     f32 vertexMaxX = -FLT_MAX;
     f32 vertexMaxY = -FLT_MAX;
     f32 vertexMaxZ = -FLT_MAX;
-    for (u32 i = 0; i < g_vertexCount; i++)
+    for (u32 i = 0; i < model->vertexCount; i++)
     {
-        vertexMinX = (g_vertices[i].pos.x < vertexMinX) ? g_vertices[i].pos.x : vertexMinX;
-        vertexMinY = (g_vertices[i].pos.y < vertexMinY) ? g_vertices[i].pos.y : vertexMinY;
-        vertexMinZ = (g_vertices[i].pos.z < vertexMinZ) ? g_vertices[i].pos.z : vertexMinZ;
-        vertexMaxX = (g_vertices[i].pos.x > vertexMaxX) ? g_vertices[i].pos.x : vertexMaxX;
-        vertexMaxY = (g_vertices[i].pos.y > vertexMaxY) ? g_vertices[i].pos.y : vertexMaxY;
-        vertexMaxZ = (g_vertices[i].pos.z > vertexMaxZ) ? g_vertices[i].pos.z : vertexMaxZ;
+        vertexMinX = (model->vertices[i].pos.x < vertexMinX) ? model->vertices[i].pos.x : vertexMinX;
+        vertexMinY = (model->vertices[i].pos.y < vertexMinY) ? model->vertices[i].pos.y : vertexMinY;
+        vertexMinZ = (model->vertices[i].pos.z < vertexMinZ) ? model->vertices[i].pos.z : vertexMinZ;
+        vertexMaxX = (model->vertices[i].pos.x > vertexMaxX) ? model->vertices[i].pos.x : vertexMaxX;
+        vertexMaxY = (model->vertices[i].pos.y > vertexMaxY) ? model->vertices[i].pos.y : vertexMaxY;
+        vertexMaxZ = (model->vertices[i].pos.z > vertexMaxZ) ? model->vertices[i].pos.z : vertexMaxZ;
     }
 
     f32 bBoxExtentX = vertexMaxX - vertexMinX;
@@ -82,72 +228,104 @@ static void normalizeAndCenterModel()
     f32 bBoxCenterX = vertexMinX + bBoxExtentX * 0.5f;
     f32 bBoxCenterY = vertexMinY + bBoxExtentY * 0.5f;
     f32 bBoxCenterZ = vertexMinZ + bBoxExtentZ * 0.5f;
-    for (u32 i = 0; i < g_vertexCount; i++)
+    for (u32 i = 0; i < model->vertexCount; i++)
     {
-        g_vertices[i].pos.x -= bBoxCenterX;
-        g_vertices[i].pos.y -= bBoxCenterY;
-        g_vertices[i].pos.z -= bBoxCenterZ;
+        model->vertices[i].pos.x -= bBoxCenterX;
+        model->vertices[i].pos.y -= bBoxCenterY;
+        model->vertices[i].pos.z -= bBoxCenterZ;
 
-        g_vertices[i].pos.x /= normalizationScalar;
-        g_vertices[i].pos.y /= normalizationScalar;
-        g_vertices[i].pos.z /= normalizationScalar;
+        model->vertices[i].pos.x /= normalizationScalar;
+        model->vertices[i].pos.y /= normalizationScalar;
+        model->vertices[i].pos.z /= normalizationScalar;
 
-        g_vertices[i].texCoord.x = g_vertices[i].pos.y;
-        g_vertices[i].texCoord.y = g_vertices[i].pos.z;
+        model->vertices[i].texCoord.x = model->vertices[i].pos.y;
+        model->vertices[i].texCoord.y = model->vertices[i].pos.z;
     }
 }
 
-static u32* readShaderBytecode(const char* filePath, const char* mode, usize* outBytesRead)
+// Makes the winding consistent and outward facing, returning whether the
+// mesh is closed so that its back faces can be culled
+static bool orientModelWinding(Model* model)
 {
-    FILE* file = fopen(filePath, mode);
-    if (file == NULL)
-        PANIC("%s%s\n", "Failed to open file: ", filePath);
-
-    if (fseek(file, 0, SEEK_END) == -1)
-        PANIC("%s%s\n", "Failed to seek end of file: ", filePath);
+    MeshWindingReport report;
+    orientMeshWinding(model->vertices, model->vertexCount, model->indices, model->indexCount, &report);
+    INFORM("%s%u%s%u%s%u%s%s\n", "Flipped ", report.flippedTriangleCount, " of ", report.triangleCount, " triangles in ",
+        report.componentCount, " connected pieces, the mesh is ", report.closed ? "closed" : "open");
+    return report.closed;
+}
 
-    long fileSize = ftell(file);
-    if (fileSize == -1)
-        PANIC("%s%s\n", "Failed to determine size of file: ", filePath);
+static void loadModel(const char* filename, Model* outModel)
+{
+    parseObjFile(filename, &outModel->vertices, &outModel->vertexCount, &outModel->indices, &outModel->indexCount);
+    normalizeAndCenterModel(outModel);
+    outModel->closed = orientModelWinding(outModel);
+}
 
-    rewind(file);
+static void freeModel(Model* model)
+{
+    freeAndNull(model->vertices);
+    freeAndNull(model->indices);
+    *model = (Model){0};
+}
 
-    ASSERT(sizeof(void*) % sizeof(u32) == 0);
-    void* bytecode;
-    if (posix_memalign(&bytecode, sizeof(void*), fileSize) != 0)
-        PANIC("%s%s\n", "Failed to allocate memory for file: ", filePath);
+static void buildDrawCommands()
+{
+    u32 chunkIndexCount = DRAW_CHUNK_TRIANGLE_COUNT * 3;
+    g_drawCommandCount = (g_model.indexCount + chunkIndexCount - 1) / chunkIndexCount;
+    g_drawCommands = mallocOrDie(g_drawCommandCount * sizeof(DrawCommand));
 
-    size_t bytesRead = fread(bytecode, 1, fileSize, file);
+    for (u32 i = 0; i < g_drawCommandCount; i++)
+    {
+        u32 firstIndex = i * chunkIndexCount;
+        u32 remainingIndexCount = g_model.indexCount - firstIndex;
+        g_drawCommands[i] = (DrawCommand){
+            .firstIndex = firstIndex,
+            .indexCount = (remainingIndexCount < chunkIndexCount) ? remainingIndexCount : chunkIndexCount
+        };
+    }
+}
 
-    if (fclose(file) == EOF)
-        INFORM("%s%s\n", "Failed to close file: ", filePath);
-    
-    if (bytesRead != fileSize || ferror(file))
-        PANIC("%s%s\n", "Failed to read file: ", filePath);
+// Vulkan 1.0 loaders have no vkEnumerateInstanceVersion and reject
+// instances asking for a newer version
+static u32 getInstanceApiVersion()
+{
+    PFN_vkEnumerateInstanceVersion enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion)vkGetInstanceProcAddr(VK_NULL_HANDLE, "vkEnumerateInstanceVersion");
 
-    if (outBytesRead != NULL)
-        *outBytesRead = (usize)bytesRead;
+    u32 apiVersion = VK_API_VERSION_1_0;
+    if (enumerateInstanceVersion != NULL && enumerateInstanceVersion(&apiVersion) != VK_SUCCESS)
+        apiVersion = VK_API_VERSION_1_0;
 
-    return bytecode;
+    return (apiVersion < VK_API_VERSION_1_3) ? apiVersion : VK_API_VERSION_1_3;
 }
 
-VkInstance createVulkanInstance()
+VkInstance createVulkanInstance(bool headless, u32* outApiVersion)
 {
     u32 glfwExtensionCount = 0;
-    const char** glfwExtensionNames = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    if (glfwExtensionNames == NULL)
-        PANIC("%s\n", "System does not provide the Vulkan instance extensions required by GLFW");
+    const char** glfwExtensionNames = NULL;
+    if (!headless)
+    {
+        glfwExtensionNames = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        if (glfwExtensionNames == NULL)
+            PANIC("%s\n", "System does not provide the Vulkan instance extensions required by GLFW");
+    }
 
     u32 enabledExtensionCount = instanceExtensionCount + glfwExtensionCount;
     const char** enabledExtensionNames = mallocOrDie(enabledExtensionCount * sizeof(char*));
     memcpy(enabledExtensionNames, instanceExtensionNames, instanceExtensionCount * sizeof(char*));
     memcpy(enabledExtensionNames + instanceExtensionCount, glfwExtensionNames, glfwExtensionCount * sizeof(char*));
 
+    VkApplicationInfo applicationInfo = {
+        .sType = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = WINDOW_TITLE,
+        .apiVersion = getInstanceApiVersion()
+    };
+
     VkInstanceCreateInfo instanceCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
 #ifdef APPLE
         .flags = VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR,
 #endif
+        .pApplicationInfo = &applicationInfo,
         .enabledLayerCount = validationLayerCount,
         .ppEnabledLayerNames = validationLayerNames,
         .enabledExtensionCount = enabledExtensionCount,
@@ -160,11 +338,44 @@ VkInstance createVulkanInstance()
 
     freeAndNull(enabledExtensionNames);
 
+    if (outApiVersion != NULL)
+        *outApiVersion = applicationInfo.apiVersion;
+
     return instance;
 }
 
-VkPhysicalDevice pickPhysicalDeviceAndQueueFamily(VkInstance instance, VkSurfaceKHR surface, u32* outQueueFamilyIndex)
+// Prefers a transfer family without graphics or compute support, which
+// usually maps to a dedicated DMA engine, and falls back to the graphics
+// family when there is none
+static u32 pickTransferQueueFamily(VkPhysicalDevice physicalDevice, u32 graphicsQueueFamilyIndex)
+{
+    u32 queueFamilyPropertiesCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, NULL);
+    VkQueueFamilyProperties* queueFamilyProperties = mallocOrDie(sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertiesCount, queueFamilyProperties);
+
+    u32 transferQueueFamilyIndex = graphicsQueueFamilyIndex;
+    for (u32 i = 0; i < queueFamilyPropertiesCount; i++)
+    {
+        VkQueueFlags queueFlags = queueFamilyProperties[i].queueFlags;
+        if (!(queueFlags & VK_QUEUE_TRANSFER_BIT) || (queueFlags & VK_QUEUE_GRAPHICS_BIT))
+            continue;
+
+        transferQueueFamilyIndex = i;
+        if (!(queueFlags & VK_QUEUE_COMPUTE_BIT))
+            break;
+    }
+
+    freeAndNull(queueFamilyProperties);
+
+    return transferQueueFamilyIndex;
+}
+
+// Pass VK_NULL_HANDLE as surface to pick a device for offscreen rendering only
+VkPhysicalDevice pickPhysicalDeviceAndQueueFamily(VkInstance instance, u32 instanceApiVersion, VkSurfaceKHR surface, u32* outQueueFamilyIndex, u32* outTransferQueueFamilyIndex)
 {
+    bool headless = surface == VK_NULL_HANDLE;
+
     u32 physicalDeviceCount = 0;
     if (vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, NULL) != VK_SUCCESS)
         PANIC("%s\n", "Failed to determine physical device count");
@@ -177,6 +388,10 @@ VkPhysicalDevice pickPhysicalDeviceAndQueueFamily(VkInstance instance, VkSurface
     u32 queueFamilyIndex = 0;
     for (u32 i = 0; i < physicalDeviceCount && physicalDevice == VK_NULL_HANDLE; i++)
     {
+        // Frames and uploads are all tracked on a timeline semaphore
+        if (!isGpuTimelineSupported(physicalDevices[i], instanceApiVersion))
+            continue;
+
         u32 queueFamilyPropertiesCount = 0;
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[i], &queueFamilyPropertiesCount, NULL);
         VkQueueFamilyProperties* queueFamilyProperties = mallocOrDie(sizeof(VkQueueFamilyProperties) * queueFamilyPropertiesCount);
@@ -187,8 +402,9 @@ VkPhysicalDevice pickPhysicalDeviceAndQueueFamily(VkInstance instance, VkSurface
             if (!(queueFamilyProperties[j].queueFlags & VK_QUEUE_GRAPHICS_BIT))
                 continue;
 
-            VkBool32 presentSupport = false;
-            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], j, surface, &presentSupport);
+            VkBool32 presentSupport = headless;
+            if (!headless)
+                vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], j, surface, &presentSupport);
             if (!presentSupport)
                 continue;
 
@@ -201,7 +417,7 @@ VkPhysicalDevice pickPhysicalDeviceAndQueueFamily(VkInstance instance, VkSurface
                 PANIC("%s\n", "Failed to enumerate physical device extension properties");
             
             bool requiredDeviceExtensionsAvailable = true;
-            for (usize x = 0; x < ARR_LEN(deviceExtensionNames); x++)
+            for (u32 x = 0; x < getDeviceExtensionCount(headless); x++)
             {
                 bool isExtensionAvailable = false;
                 for (u32 y = 0; y < deviceExtensionPropertiesCount; y++)
@@ -214,11 +430,6 @@ VkPhysicalDevice pickPhysicalDeviceAndQueueFamily(VkInstance instance, VkSurface
             if (!requiredDeviceExtensionsAvailable)
                 continue;
 
-            VkPhysicalDeviceFeatures physicalDeviceFeatures;
-            vkGetPhysicalDeviceFeatures(physicalDevices[i], &physicalDeviceFeatures);
-            if (!physicalDeviceFeatures.samplerAnisotropy)
-                continue;
-
             physicalDevice = physicalDevices[i];
             queueFamilyIndex = j;
             break;
@@ -235,19 +446,61 @@ VkPhysicalDevice pickPhysicalDeviceAndQueueFamily(VkInstance instance, VkSurface
     if (outQueueFamilyIndex != NULL)
         *outQueueFamilyIndex = queueFamilyIndex;
 
+    if (outTransferQueueFamilyIndex != NULL)
+        *outTransferQueueFamilyIndex = pickTransferQueueFamily(physicalDevice, queueFamilyIndex);
+
     return physicalDevice;
 }
 
-u32 pickMemoryType(VkPhysicalDevice physicalDevice, u32 typeFilter, VkMemoryPropertyFlags properties)
+// Dynamic rendering and synchronization2 are both core in Vulkan 1.3, which
+// the instance has to have been created with as well
+static bool isDynamicRenderingSupported(VkPhysicalDevice physicalDevice, u32 instanceApiVersion)
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    if (instanceApiVersion < VK_API_VERSION_1_3 || properties.apiVersion < VK_API_VERSION_1_3)
+        return false;
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES
+    };
+
+    VkPhysicalDeviceFeatures2 features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+        .pNext = &vulkan13Features
+    };
+
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+    return vulkan13Features.dynamicRendering && vulkan13Features.synchronization2;
+}
+
+static bool isDeviceExtensionSupported(VkPhysicalDevice physicalDevice, const char* extensionName)
 {
-    VkPhysicalDeviceMemoryProperties memoryProperties;
-    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    u32 extensionPropertiesCount;
+    if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionPropertiesCount, NULL) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to determine physical device extension properties count");
+
+    VkExtensionProperties* extensionProperties = mallocOrDie(sizeof(VkExtensionProperties) * extensionPropertiesCount);
+    if (vkEnumerateDeviceExtensionProperties(physicalDevice, NULL, &extensionPropertiesCount, extensionProperties) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to enumerate physical device extension properties");
 
-    for (u32 i = 0; i < memoryProperties.memoryTypeCount; i++)
-        if ((typeFilter & (1 << i)) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties)
-            return i;
+    bool supported = false;
+    for (u32 i = 0; i < extensionPropertiesCount && !supported; i++)
+        supported = strcmp(extensionName, extensionProperties[i].extensionName) == 0;
 
-    PANIC("%s\n", "Failed to find suitable memory type");
+    freeAndNull(extensionProperties);
+
+    return supported;
+}
+
+static void loadDynamicRenderingFunctions(VkDevice device)
+{
+    g_vkCmdBeginRendering = (PFN_vkCmdBeginRendering)vkGetDeviceProcAddr(device, "vkCmdBeginRendering");
+    g_vkCmdEndRendering = (PFN_vkCmdEndRendering)vkGetDeviceProcAddr(device, "vkCmdEndRendering");
+    g_vkCmdPipelineBarrier2 = (PFN_vkCmdPipelineBarrier2)vkGetDeviceProcAddr(device, "vkCmdPipelineBarrier2");
+
+    if (g_vkCmdBeginRendering == NULL || g_vkCmdEndRendering == NULL || g_vkCmdPipelineBarrier2 == NULL)
+        PANIC("%s\n", "Failed to load dynamic rendering functions");
 }
 
 VkSurfaceFormatKHR pickSurfaceFormat(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
@@ -278,7 +531,8 @@ VkSurfaceFormatKHR pickSurfaceFormat(VkPhysicalDevice physicalDevice, VkSurfaceK
     return format;
 }
 
-VkPresentModeKHR pickSurfacePresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface)
+// Falls back to FIFO when the requested mode is not supported
+VkPresentModeKHR pickSurfacePresentMode(VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, VkPresentModeKHR requestedMode)
 {
     u32 presentModeCount;
     if (vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, NULL) != VK_SUCCESS)
@@ -288,14 +542,14 @@ VkPresentModeKHR pickSurfacePresentMode(VkPhysicalDevice physicalDevice, VkSurfa
         PANIC("%s\n", "Physical device does not support any surface present modes");
 
     VkPresentModeKHR* presentModes = mallocOrDie(sizeof(VkPresentModeKHR) * presentModeCount);
-    if (vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, NULL) != VK_SUCCESS)
+    if (vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, presentModes) != VK_SUCCESS)
         PANIC("%s\n", "Failed to enumerate physical device surface present modes");
 
     // NOTE(Hans): The standard FIFO present mode is guaranteed to exist
     VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
     for (u32 i = 0; i < presentModeCount; i++)
     {
-        if (presentModes[i] == VK_PRESENT_MODE_MAILBOX_KHR)
+        if (presentModes[i] == requestedMode)
         {
             presentMode = presentModes[i];
             break;
@@ -304,6 +558,9 @@ VkPresentModeKHR pickSurfacePresentMode(VkPhysicalDevice physicalDevice, VkSurfa
 
     freeAndNull(presentModes);
 
+    if (presentMode != requestedMode)
+        INFORM("%s%s%s\n", "Present mode ", getPresentModeName(requestedMode), " is not supported, falling back to fifo");
+
     return presentMode;
 }
 
@@ -318,19 +575,22 @@ VkExtent2D querySurfaceExtent(GLFWwindow* window, VkSurfaceCapabilitiesKHR surfa
 
         u32 minWidth = surfaceCapabilities.minImageExtent.width;
         u32 maxWidth = surfaceCapabilities.maxImageExtent.width;
-        extent.width = ((u32)width > minWidth) ? width : minWidth;
-        extent.width = ((u32)width < maxWidth) ? width : maxWidth;
+        extent.width = ((u32)width > minWidth) ? (u32)width : minWidth;
+        extent.width = (extent.width < maxWidth) ? extent.width : maxWidth;
 
         u32 minHeight = surfaceCapabilities.minImageExtent.height;
         u32 maxHeight = surfaceCapabilities.maxImageExtent.height;
         extent.height = ((u32)height > minHeight) ? (u32)height : minHeight;
-        extent.height = ((u32)height < maxHeight) ? (u32)height : maxHeight;
+        extent.height = (extent.height < maxHeight) ? extent.height : maxHeight;
     }
 
     return extent;
 }
 
-VkRenderPass createRenderPass(VkDevice device, VkFormat pixelFormat)
+// finalLayout is PRESENT_SRC for swapchain images, or TRANSFER_SRC for
+// offscreen images that are copied out after the pass. With a depth
+// pre-pass, subpass 0 only writes depth and subpass 1 shades against it.
+VkRenderPass createRenderPass(VkDevice device, VkFormat pixelFormat, VkImageLayout finalLayout, bool depthPrepass)
 {
     VkAttachmentDescription attachmentDescriptions[]  = {
         { // Color
@@ -341,7 +601,7 @@ VkRenderPass createRenderPass(VkDevice device, VkFormat pixelFormat)
             .stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
             .stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
             .initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-            .finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
+            .finalLayout = finalLayout
         },
         { // Depth
             .format = VK_FORMAT_D32_SFLOAT,
@@ -365,14 +625,26 @@ VkRenderPass createRenderPass(VkDevice device, VkFormat pixelFormat)
         .layout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL
     };
 
-    VkSubpassDescription subpassDescription = {
-        .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
-        .colorAttachmentCount = 1,
-        .pColorAttachments = &colorAttachmentReference,
-        .pDepthStencilAttachment = &depthAttachmentReference
+    VkSubpassDescription subpassDescriptions[] = {
+        { // Depth pre-pass
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 0,
+            .pDepthStencilAttachment = &depthAttachmentReference
+        },
+        {
+            .pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
+            .colorAttachmentCount = 1,
+            .pColorAttachments = &colorAttachmentReference,
+            .pDepthStencilAttachment = &depthAttachmentReference
+        }
     };
 
-    VkSubpassDependency subpassDependency = {
+    u32 colorSubpass = depthPrepass ? 1 : 0;
+
+    VkSubpassDependency subpassDependencies[3];
+    u32 subpassDependencyCount = 0;
+
+    subpassDependencies[subpassDependencyCount++] = (VkSubpassDependency){
         .srcSubpass = VK_SUBPASS_EXTERNAL,
         .dstSubpass = 0,
         .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
@@ -381,14 +653,41 @@ VkRenderPass createRenderPass(VkDevice device, VkFormat pixelFormat)
         .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT
     };
 
+    // The color pass tests against the finished pre-pass depth. Color is
+    // first written there, so it also waits for the acquired image.
+    if (depthPrepass)
+    {
+        subpassDependencies[subpassDependencyCount++] = (VkSubpassDependency){
+            .srcSubpass = 0,
+            .dstSubpass = 1,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT
+        };
+    }
+
+    // Makes the color writes and final layout visible to readback copies
+    if (finalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL)
+    {
+        subpassDependencies[subpassDependencyCount++] = (VkSubpassDependency){
+            .srcSubpass = colorSubpass,
+            .dstSubpass = VK_SUBPASS_EXTERNAL,
+            .srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT,
+            .srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+            .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+        };
+    }
+
     VkRenderPassCreateInfo renderPassCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
         .attachmentCount = 2,
         .pAttachments = attachmentDescriptions,
-        .subpassCount = 1,
-        .pSubpasses = &subpassDescription,
-        .dependencyCount = 1,
-        .pDependencies = &subpassDependency
+        .subpassCount = depthPrepass ? 2 : 1,
+        .pSubpasses = depthPrepass ? subpassDescriptions : &subpassDescriptions[1],
+        .dependencyCount = subpassDependencyCount,
+        .pDependencies = subpassDependencies
     };
 
     VkRenderPass renderPass;
@@ -398,46 +697,68 @@ VkRenderPass createRenderPass(VkDevice device, VkFormat pixelFormat)
     return renderPass;
 }
 
-VkPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkDescriptorSetLayout descriptorSetLayout, VkPipelineLayout* outPipelineLayout)
+// Without fillModeNonSolid the wireframe mode falls back to filled triangles.
+// With depthPrepass the pipelines only shade fragments whose depth equals
+// what the pre-pass left behind, in the second subpass of renderPass. For
+// dynamic rendering renderPass is VK_NULL_HANDLE and renderingCreateInfo
+// describes the attachments instead.
+void createGraphicsPipelines(VkDevice device, VkPipelineCache pipelineCache, VkRenderPass renderPass, const VkPipelineRenderingCreateInfo* renderingCreateInfo,
+    VkDescriptorSetLayout descriptorSetLayout, bool fillModeNonSolid,
+    bool depthPrepass, VkPipelineLayout* outPipelineLayout, VkPipeline outPipelines[CULL_VARIANT_COUNT][SHADING_MODE_COUNT])
 {
     VkShaderModuleCreateInfo shaderModuleCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO
     };
 
-    usize vertShaderCodeSize;
-    u32* vertShaderCode = readShaderBytecode("shaders/vert.spv", "rb", &vertShaderCodeSize);
-    shaderModuleCreateInfo.codeSize = vertShaderCodeSize;
-    shaderModuleCreateInfo.pCode = vertShaderCode;
+    shaderModuleCreateInfo.codeSize = sizeof(g_vertShaderCode);
+    shaderModuleCreateInfo.pCode = g_vertShaderCode;
 
     VkShaderModule vertShaderModule;
     if (vkCreateShaderModule(device, &shaderModuleCreateInfo, NULL, &vertShaderModule) != VK_SUCCESS)
         PANIC("%s\n", "Failed to create vertex shader module");
-    freeAndNull(vertShaderCode);
 
-    usize fragShaderCodeSize;
-    u32* fragShaderCode = readShaderBytecode("shaders/frag.spv", "rb", &fragShaderCodeSize);
-    shaderModuleCreateInfo.codeSize = fragShaderCodeSize;
-    shaderModuleCreateInfo.pCode = fragShaderCode;
+    shaderModuleCreateInfo.codeSize = sizeof(g_fragShaderCode);
+    shaderModuleCreateInfo.pCode = g_fragShaderCode;
 
     VkShaderModule fragShaderModule;
     if (vkCreateShaderModule(device, &shaderModuleCreateInfo, NULL, &fragShaderModule) != VK_SUCCESS)
         PANIC("%s\n", "Failed to create fragment shader module");
-    freeAndNull(fragShaderCode);
 
-    VkPipelineShaderStageCreateInfo shaderStageCreateInfos[] = {
-        {
+    VkSpecializationMapEntry specializationMapEntry = {
+        .constantID = 0,
+        .offset = 0,
+        .size = sizeof(u32)
+    };
+
+    u32 shadingModes[SHADING_MODE_COUNT];
+    VkSpecializationInfo specializationInfos[SHADING_MODE_COUNT];
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfos[SHADING_MODE_COUNT][2];
+    for (u32 i = 0; i < SHADING_MODE_COUNT; i++)
+    {
+        shadingModes[i] = i;
+
+        specializationInfos[i] = (VkSpecializationInfo){
+            .mapEntryCount = 1,
+            .pMapEntries = &specializationMapEntry,
+            .dataSize = sizeof(shadingModes[i]),
+            .pData = &shadingModes[i]
+        };
+
+        shaderStageCreateInfos[i][0] = (VkPipelineShaderStageCreateInfo){
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
             .stage = VK_SHADER_STAGE_VERTEX_BIT,
             .module = vertShaderModule,
             .pName = "main"
-        },
-        {
+        };
+
+        shaderStageCreateInfos[i][1] = (VkPipelineShaderStageCreateInfo){
             .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
             .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
             .module = fragShaderModule,
-            .pName = "main"
-        },
-    };
+            .pName = "main",
+            .pSpecializationInfo = &specializationInfos[i]
+        };
+    }
 
     VkDynamicState dynamicStates[] = {
         VK_DYNAMIC_STATE_VIEWPORT,
@@ -485,6 +806,11 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkDe
         .primitiveRestartEnable = VK_FALSE
     };
 
+    // The density view draws the same indices as points, so every triangle
+    // adds one point at each of its corners
+    VkPipelineInputAssemblyStateCreateInfo pointInputAssemblyStateCreateInfo = inputAssemblyStateCreateInfo;
+    pointInputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_POINT_LIST;
+
     VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
         .viewportCount = 1,
@@ -500,6 +826,18 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkDe
         .lineWidth = 1.f
     };
 
+    VkPipelineRasterizationStateCreateInfo wireframeRasterizationStateCreateInfo = rasterizationStateCreateInfo;
+    if (fillModeNonSolid)
+        wireframeRasterizationStateCreateInfo.polygonMode = VK_POLYGON_MODE_LINE;
+    else
+        INFORM("%s\n", "fillModeNonSolid is not supported, the wireframe view draws filled triangles");
+
+    // Outward faces are counter-clockwise after orientMeshWinding
+    VkPipelineRasterizationStateCreateInfo culledRasterizationStateCreateInfo = rasterizationStateCreateInfo;
+    culledRasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+    VkPipelineRasterizationStateCreateInfo culledWireframeRasterizationStateCreateInfo = wireframeRasterizationStateCreateInfo;
+    culledWireframeRasterizationStateCreateInfo.cullMode = VK_CULL_MODE_BACK_BIT;
+
     VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
         .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
@@ -515,6 +853,21 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkDe
         .stencilTestEnable = VK_FALSE
     };
 
+    // Counting views see every fragment, hidden or not
+    VkPipelineDepthStencilStateCreateInfo countingDepthStencilStateCreateInfo = depthStencilStateCreateInfo;
+    countingDepthStencilStateCreateInfo.depthTestEnable = VK_FALSE;
+    countingDepthStencilStateCreateInfo.depthWriteEnable = VK_FALSE;
+
+    // The positions match the pre-pass bit for bit (gl_Position is
+    // invariant in both shaders), so only the front-most surface passes
+    VkPipelineDepthStencilStateCreateInfo equalDepthStencilStateCreateInfo = depthStencilStateCreateInfo;
+    equalDepthStencilStateCreateInfo.depthWriteEnable = VK_FALSE;
+    equalDepthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_EQUAL;
+
+    // Rasterized lines do not reproduce the triangle depths exactly
+    VkPipelineDepthStencilStateCreateInfo wireframeDepthStencilStateCreateInfo = equalDepthStencilStateCreateInfo;
+    wireframeDepthStencilStateCreateInfo.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+
     VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {
         .blendEnable = VK_FALSE,
         .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
@@ -527,6 +880,21 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkDe
         .pAttachments = &colorBlendAttachmentState
     };
 
+    // Each fragment adds a fixed amount, so brightness counts fragments
+    VkPipelineColorBlendAttachmentState additiveColorBlendAttachmentState = {
+        .blendEnable = VK_TRUE,
+        .srcColorBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstColorBlendFactor = VK_BLEND_FACTOR_ONE,
+        .colorBlendOp = VK_BLEND_OP_ADD,
+        .srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+        .alphaBlendOp = VK_BLEND_OP_ADD,
+        .colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT
+    };
+
+    VkPipelineColorBlendStateCreateInfo additiveColorBlendStateCreateInfo = colorBlendStateCreateInfo;
+    additiveColorBlendStateCreateInfo.pAttachments = &additiveColorBlendAttachmentState;
+
     VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
         .setLayoutCount = 1,
@@ -537,10 +905,169 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkDe
     if (vkCreatePipelineLayout(device, &pipelineLayoutCreateInfo, NULL, &pipelineLayout) != VK_SUCCESS)
         PANIC("%s\n", "Failed to create pipeline layout");
 
+    VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfos[CULL_VARIANT_COUNT][SHADING_MODE_COUNT];
+    VkGraphicsPipelineCreateInfo* unculledCreateInfos = graphicsPipelineCreateInfos[CULL_VARIANT_NONE];
+    for (u32 i = 0; i < SHADING_MODE_COUNT; i++)
+    {
+        unculledCreateInfos[i] = (VkGraphicsPipelineCreateInfo){
+            .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
+            .pNext = renderingCreateInfo,
+            .stageCount = 2,
+            .pStages = shaderStageCreateInfos[i],
+            .pVertexInputState = &vertexInputStateCreateInfo,
+            .pInputAssemblyState = &inputAssemblyStateCreateInfo,
+            .pViewportState = &viewportStateCreateInfo,
+            .pRasterizationState = &rasterizationStateCreateInfo,
+            .pMultisampleState = &multisampleStateCreateInfo,
+            .pDepthStencilState = depthPrepass ? &equalDepthStencilStateCreateInfo : &depthStencilStateCreateInfo,
+            .pColorBlendState = &colorBlendStateCreateInfo,
+            .pDynamicState = &dynamicStateCreateInfo,
+            .layout = pipelineLayout,
+            .renderPass = renderPass,
+            .subpass = (depthPrepass && renderPass != VK_NULL_HANDLE) ? 1 : 0
+        };
+    }
+
+    unculledCreateInfos[SHADING_MODE_OVERDRAW].pDepthStencilState = &countingDepthStencilStateCreateInfo;
+    unculledCreateInfos[SHADING_MODE_OVERDRAW].pColorBlendState = &additiveColorBlendStateCreateInfo;
+
+    unculledCreateInfos[SHADING_MODE_DENSITY].pInputAssemblyState = &pointInputAssemblyStateCreateInfo;
+    unculledCreateInfos[SHADING_MODE_DENSITY].pDepthStencilState = &countingDepthStencilStateCreateInfo;
+    unculledCreateInfos[SHADING_MODE_DENSITY].pColorBlendState = &additiveColorBlendStateCreateInfo;
+
+    unculledCreateInfos[SHADING_MODE_WIREFRAME].pRasterizationState = &wireframeRasterizationStateCreateInfo;
+    if (depthPrepass)
+        unculledCreateInfos[SHADING_MODE_WIREFRAME].pDepthStencilState = &wireframeDepthStencilStateCreateInfo;
+
+    VkGraphicsPipelineCreateInfo* culledCreateInfos = graphicsPipelineCreateInfos[CULL_VARIANT_BACK];
+    for (u32 i = 0; i < SHADING_MODE_COUNT; i++)
+    {
+        culledCreateInfos[i] = unculledCreateInfos[i];
+        culledCreateInfos[i].pRasterizationState = &culledRasterizationStateCreateInfo;
+    }
+    culledCreateInfos[SHADING_MODE_WIREFRAME].pRasterizationState = &culledWireframeRasterizationStateCreateInfo;
+
+    ASSERT(outPipelines != NULL);
+    if (vkCreateGraphicsPipelines(device, pipelineCache, CULL_VARIANT_COUNT * SHADING_MODE_COUNT, &graphicsPipelineCreateInfos[0][0], NULL, &outPipelines[0][0]) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to create graphics pipelines");
+
+    vkDestroyShaderModule(device, vertShaderModule, NULL);
+    vkDestroyShaderModule(device, fragShaderModule, NULL);
+
+    ASSERT(outPipelineLayout != NULL);
+    *outPipelineLayout = pipelineLayout;
+}
+
+// Depth-only pipeline for subpass 0 of a pre-pass render pass, or for a
+// depth-only dynamic rendering pass. It reads a tightly packed position
+// stream and has no fragment shader.
+VkPipeline createDepthPrepassPipeline(VkDevice device, VkPipelineCache pipelineCache, VkRenderPass renderPass, const VkPipelineRenderingCreateInfo* renderingCreateInfo,
+    VkPipelineLayout pipelineLayout, CullVariant cullVariant)
+{
+    VkPipelineRenderingCreateInfo depthOnlyRenderingCreateInfo = {0};
+    if (renderingCreateInfo != NULL)
+    {
+        depthOnlyRenderingCreateInfo = *renderingCreateInfo;
+        depthOnlyRenderingCreateInfo.colorAttachmentCount = 0;
+        depthOnlyRenderingCreateInfo.pColorAttachmentFormats = NULL;
+    }
+
+    VkShaderModuleCreateInfo shaderModuleCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = sizeof(g_depthVertShaderCode),
+        .pCode = g_depthVertShaderCode
+    };
+
+    VkShaderModule vertShaderModule;
+    if (vkCreateShaderModule(device, &shaderModuleCreateInfo, NULL, &vertShaderModule) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to create depth pre-pass vertex shader module");
+
+    VkPipelineShaderStageCreateInfo shaderStageCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
+        .stage = VK_SHADER_STAGE_VERTEX_BIT,
+        .module = vertShaderModule,
+        .pName = "main"
+    };
+
+    VkDynamicState dynamicStates[] = {
+        VK_DYNAMIC_STATE_VIEWPORT,
+        VK_DYNAMIC_STATE_SCISSOR
+    };
+
+    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO,
+        .dynamicStateCount = ARR_LEN(dynamicStates),
+        .pDynamicStates = dynamicStates
+    };
+
+    VkVertexInputBindingDescription vertexInputBindingDescription = {
+        .binding = 0,
+        .stride = sizeof(Vec3),
+        .inputRate = VK_VERTEX_INPUT_RATE_VERTEX
+    };
+
+    VkVertexInputAttributeDescription vertexInputAttributeDescription = {
+        .binding = 0,
+        .location = 0,
+        .format = VK_FORMAT_R32G32B32_SFLOAT,
+        .offset = 0
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+        .vertexBindingDescriptionCount = 1,
+        .pVertexBindingDescriptions = &vertexInputBindingDescription,
+        .vertexAttributeDescriptionCount = 1,
+        .pVertexAttributeDescriptions = &vertexInputAttributeDescription
+    };
+
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
+        .topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST,
+        .primitiveRestartEnable = VK_FALSE
+    };
+
+    VkPipelineViewportStateCreateInfo viewportStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO,
+        .viewportCount = 1,
+        .scissorCount = 1
+    };
+
+    VkPipelineRasterizationStateCreateInfo rasterizationStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO,
+        .polygonMode = VK_POLYGON_MODE_FILL,
+        .cullMode = (cullVariant == CULL_VARIANT_BACK) ? VK_CULL_MODE_BACK_BIT : VK_CULL_MODE_NONE,
+        .frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE,
+        .depthBiasEnable = VK_FALSE,
+        .lineWidth = 1.f
+    };
+
+    VkPipelineMultisampleStateCreateInfo multisampleStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT,
+        .sampleShadingEnable = VK_FALSE
+    };
+
+    VkPipelineDepthStencilStateCreateInfo depthStencilStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+        .depthTestEnable = VK_TRUE,
+        .depthWriteEnable = VK_TRUE,
+        .depthCompareOp = VK_COMPARE_OP_LESS,
+        .depthBoundsTestEnable = VK_FALSE,
+        .stencilTestEnable = VK_FALSE
+    };
+
+    VkPipelineColorBlendStateCreateInfo colorBlendStateCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
+        .logicOpEnable = VK_FALSE,
+        .attachmentCount = 0
+    };
+
     VkGraphicsPipelineCreateInfo graphicsPipelineCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
-        .stageCount = 2,
-        .pStages = shaderStageCreateInfos,
+        .pNext = (renderingCreateInfo != NULL) ? &depthOnlyRenderingCreateInfo : NULL,
+        .stageCount = 1,
+        .pStages = &shaderStageCreateInfo,
         .pVertexInputState = &vertexInputStateCreateInfo,
         .pInputAssemblyState = &inputAssemblyStateCreateInfo,
         .pViewportState = &viewportStateCreateInfo,
@@ -554,20 +1081,51 @@ VkPipeline createGraphicsPipeline(VkDevice device, VkRenderPass renderPass, VkDe
         .subpass = 0
     };
 
-    VkPipeline graphicsPipeline;
-    if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &graphicsPipelineCreateInfo, NULL, &graphicsPipeline) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to create graphics pipeline");
+    VkPipeline pipeline;
+    if (vkCreateGraphicsPipelines(device, pipelineCache, 1, &graphicsPipelineCreateInfo, NULL, &pipeline) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to create depth pre-pass pipeline");
 
     vkDestroyShaderModule(device, vertShaderModule, NULL);
-    vkDestroyShaderModule(device, fragShaderModule, NULL);
+    return pipeline;
+}
 
-    ASSERT(outPipelineLayout != NULL);
-    *outPipelineLayout = pipelineLayout;
+static ShadingMode pickShadingMode(f32 colorToTextureRatio, DebugView debugView)
+{
+    if (debugView == DEBUG_VIEW_OVERDRAW)
+        return SHADING_MODE_OVERDRAW;
+    if (debugView == DEBUG_VIEW_DENSITY)
+        return SHADING_MODE_DENSITY;
+    if (debugView == DEBUG_VIEW_WIREFRAME)
+        return SHADING_MODE_WIREFRAME;
+
+    if (colorToTextureRatio <= 0.0f)
+        return SHADING_MODE_COLOR;
+    if (colorToTextureRatio >= 1.0f)
+        return SHADING_MODE_TEXTURE;
+    return SHADING_MODE_BLEND;
+}
+
+static void computeViewportAndScissor(VkExtent2D extent, VkViewport* outViewport, VkRect2D* outScissor)
+{
+    *outViewport = (VkViewport){
+        .x = 0.f,
+        .y = 0.f,
+        .width = (f32)extent.width,
+        .height = (f32)extent.height,
+        .minDepth = 0.f,
+        .maxDepth = 1.f
+    };
 
-    return graphicsPipeline;
+    *outScissor = (VkRect2D){
+        .offset = {0, 0},
+        .extent = extent
+    };
 }
 
-static VkSwapchainKHR createSwapchain(VkDevice device, VkSurfaceKHR surface, VkSurfaceCapabilitiesKHR surfaceCapabilities, VkSurfaceFormatKHR surfaceFormat, VkPresentModeKHR surfacePresentMode, VkExtent2D surfaceExtent)
+// Passing the swapchain being replaced as oldSwapchain lets the driver
+// recycle its resources and keeps already queued presents valid
+static VkSwapchainKHR createSwapchain(VkDevice device, VkSurfaceKHR surface, VkSurfaceCapabilitiesKHR surfaceCapabilities, VkSurfaceFormatKHR surfaceFormat,
+    VkPresentModeKHR surfacePresentMode, VkExtent2D surfaceExtent, VkImageUsageFlags imageUsage, VkSwapchainKHR oldSwapchain)
 {
     u32 swapchainMinImageCount = surfaceCapabilities.minImageCount + 1;
     if (surfaceCapabilities.maxImageCount > 0 && swapchainMinImageCount > surfaceCapabilities.maxImageCount)
@@ -581,12 +1139,13 @@ static VkSwapchainKHR createSwapchain(VkDevice device, VkSurfaceKHR surface, VkS
         .imageColorSpace = surfaceFormat.colorSpace,
         .imageExtent = surfaceExtent,
         .imageArrayLayers = 1,
-        .imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+        .imageUsage = imageUsage,
         .imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
         .preTransform = surfaceCapabilities.currentTransform,
         .compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR,
         .presentMode = surfacePresentMode,
-        .clipped = VK_TRUE
+        .clipped = VK_TRUE,
+        .oldSwapchain = oldSwapchain
     };
 
     VkSwapchainKHR swapchain;
@@ -596,15 +1155,17 @@ static VkSwapchainKHR createSwapchain(VkDevice device, VkSurfaceKHR surface, VkS
     return swapchain;
 }
 
+// The caller must make sure no frame still uses the swapchain
 static void destroySwapchain(VkDevice device, VkSwapchainKHR* swapchain, u32 imageCount, VkImage* images, VkImageView* imageViews, VkFramebuffer* framebuffers)
 {
-    if (vkDeviceWaitIdle(device) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to wait for device to be idle");
-
+    // Swapchains only blitted to have no views, and dynamic rendering needs
+    // no framebuffers
     for (u32 i = 0; i < imageCount; i++)
     {
-        vkDestroyFramebuffer(device, framebuffers[i], NULL);
-        vkDestroyImageView(device, imageViews[i], NULL);
+        if (framebuffers != NULL)
+            vkDestroyFramebuffer(device, framebuffers[i], NULL);
+        if (imageViews != NULL)
+            vkDestroyImageView(device, imageViews[i], NULL);
     }
 
     freeAndNull(framebuffers);
@@ -679,9 +1240,10 @@ static VkFramebuffer* createSwapchainFramebuffers(VkDevice device, VkImageView*
     return framebuffers;
 }
 
-VkBuffer createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDeviceMemory* outMemory, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+VkBuffer createBuffer(GpuAllocator* allocator, VkDevice device, GpuAllocation* outAllocation, VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties,
+    GpuMemoryCategory category)
 {
-    ASSERT(outMemory != NULL);
+    ASSERT(outAllocation != NULL);
 
     VkBufferCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -694,25 +1256,70 @@ VkBuffer createBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkDevice
     if (vkCreateBuffer(device, &createInfo, NULL, &buffer) != VK_SUCCESS)
         PANIC("%s\n", "Failed to create buffer");
 
-    VkMemoryRequirements memoryRequirements;
-    vkGetBufferMemoryRequirements(device, buffer, &memoryRequirements);
-    u32 memoryTypeIndex = pickMemoryType(physicalDevice, memoryRequirements.memoryTypeBits, properties);
-
-    VkMemoryAllocateInfo memoryAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .memoryTypeIndex = memoryTypeIndex
-    };
+    *outAllocation = allocateAndBindBufferMemory(allocator, buffer, properties, category);
 
-    if (vkAllocateMemory(device, &memoryAllocateInfo, NULL, outMemory) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to allocate buffer memory");
+    return buffer;
+}
 
-    vkBindBufferMemory(device, buffer, *outMemory, 0);
+typedef struct
+{
+    VkBuffer buffer;
+    GpuAllocation allocation;
+} StagingBuffer;
 
-    return buffer;
+// Queues used for uploads. When the device exposes a transfer-only family
+// the copies run there, concurrently with rendering, and ownership of the
+// uploaded resources is then handed over to the graphics family.
+typedef struct
+{
+    VkQueue transferQueue;
+    VkCommandPool transferCommandPool;
+    u32 transferQueueFamilyIndex;
+    VkQueue graphicsQueue;
+    VkCommandPool graphicsCommandPool;
+    u32 graphicsQueueFamilyIndex;
+    // Signaled by the graphics queue side of every batch
+    GpuTimeline* timeline;
+} UploadQueues;
+
+#define MAX_UPLOAD_BARRIERS 8
+
+// Records all transfers and layout transitions of a loading step into a
+// single command buffer that is submitted once. Completion is tracked on the
+// frame timeline and the staging buffers are released once it reaches the
+// batch's value, so uploads never stall the queue.
+typedef struct
+{
+    VkDevice device;
+    GpuAllocator* allocator;
+    UploadQueues queues;
+    VkCommandBuffer commandBuffer;
+    VkCommandBuffer acquireCommandBuffer;
+    VkSemaphore transferFinishedSemaphore;
+    // Nonzero while the batch is in flight
+    u64 timelineValue;
+    StagingBuffer* stagingBuffers;
+    u32 stagingBufferCount;
+    u32 stagingBufferCapacity;
+    // Barriers making the uploaded resources available to the graphics queue,
+    // split into release and acquire halves on a queue family transfer
+    VkBufferMemoryBarrier bufferBarriers[MAX_UPLOAD_BARRIERS];
+    u32 bufferBarrierCount;
+    VkImageMemoryBarrier imageBarriers[MAX_UPLOAD_BARRIERS];
+    u32 imageBarrierCount;
+    // Images whose mip chain is blitted on the graphics queue once level 0
+    // has arrived, indexed like imageBarriers
+    VkExtent2D imageExtents[MAX_UPLOAD_BARRIERS];
+    bool generateMipmaps[MAX_UPLOAD_BARRIERS];
+    VkPipelineStageFlags dstStageMask;
+} UploadBatch;
+
+static bool isQueueFamilyTransferNeeded(const UploadBatch* batch)
+{
+    return batch->queues.transferQueueFamilyIndex != batch->queues.graphicsQueueFamilyIndex;
 }
 
-VkCommandBuffer beginSingleTimeCommands(VkDevice device, VkCommandPool commandPool)
+static VkCommandBuffer beginOneTimeCommandBuffer(VkDevice device, VkCommandPool commandPool)
 {
     VkCommandBufferAllocateInfo allocateInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
@@ -723,7 +1330,7 @@ VkCommandBuffer beginSingleTimeCommands(VkDevice device, VkCommandPool commandPo
 
     VkCommandBuffer commandBuffer;
     if (vkAllocateCommandBuffers(device, &allocateInfo, &commandBuffer) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to allocate command buffer for buffer transfer");
+        PANIC("%s\n", "Failed to allocate command buffer for upload batch");
 
     VkCommandBufferBeginInfo beginInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
@@ -731,108 +1338,67 @@ VkCommandBuffer beginSingleTimeCommands(VkDevice device, VkCommandPool commandPo
     };
 
     if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to begin command buffer for buffer transfer");
-    
+        PANIC("%s\n", "Failed to begin command buffer for upload batch");
+
     return commandBuffer;
 }
 
-void endSingleTimeCommands(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkCommandBuffer commandBuffer)
+void beginUploadBatch(VkDevice device, GpuAllocator* allocator, const UploadQueues* queues, UploadBatch* batch)
 {
-    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to end command buffer for buffer transfer");
-    
-    VkSubmitInfo submitInfo = {
-        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-        .commandBufferCount = 1,
-        .pCommandBuffers = &commandBuffer
+    *batch = (UploadBatch){
+        .device = device,
+        .allocator = allocator,
+        .queues = *queues
     };
 
-    if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to submit command buffer for buffer transfer to queue");
+    batch->commandBuffer = beginOneTimeCommandBuffer(device, queues->transferCommandPool);
+}
+
+static VkBuffer createStagingBuffer(UploadBatch* batch, const void* data, VkDeviceSize size)
+{
+    if (batch->stagingBufferCount == batch->stagingBufferCapacity)
+    {
+        batch->stagingBufferCapacity = (batch->stagingBufferCapacity > 0) ? batch->stagingBufferCapacity * 2 : 4;
+        batch->stagingBuffers = reallocOrDie(batch->stagingBuffers, batch->stagingBufferCapacity * sizeof(StagingBuffer));
+    }
 
-    if (vkQueueWaitIdle(queue) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to wait for queue to be idle");
+    StagingBuffer* staging = &batch->stagingBuffers[batch->stagingBufferCount++];
+    staging->buffer = createBuffer(batch->allocator, batch->device, &staging->allocation, size,
+        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, GPU_MEMORY_CATEGORY_STAGING);
+    memcpy(staging->allocation.mapped, data, size);
 
-    vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+    return staging->buffer;
 }
 
-void copyBuffer(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkBuffer src, VkBuffer dst, VkDeviceSize size)
+// dstAccessMask and dstStageMask describe how the graphics queue reads dst
+void uploadBufferData(UploadBatch* batch, VkBuffer dst, const void* data, VkDeviceSize size, VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStageMask)
 {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
+    ProfileZone zone = beginProfileZone("upload buffer");
+
+    VkBuffer stagingBuffer = createStagingBuffer(batch, data, size);
     VkBufferCopy copyRegion = {.size = size};
-    vkCmdCopyBuffer(commandBuffer, src, dst, 1, &copyRegion);
-    endSingleTimeCommands(device, queue, commandPool, commandBuffer);
-}
-
-void copyBufferToImage(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkBuffer buffer, VkImage image, uint32_t width, uint32_t height) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
-
-    VkBufferImageCopy region = {
-        .imageSubresource = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-            .mipLevel = 0,
-            .baseArrayLayer = 0,
-            .layerCount = 1
-        },
-        .imageExtent = {width, height, 1}
+    vkCmdCopyBuffer(batch->commandBuffer, stagingBuffer, dst, 1, &copyRegion);
+
+    if (batch->bufferBarrierCount == MAX_UPLOAD_BARRIERS)
+        PANIC("%s\n", "Too many buffers in upload batch");
+
+    batch->bufferBarriers[batch->bufferBarrierCount++] = (VkBufferMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = dstAccessMask,
+        .srcQueueFamilyIndex = batch->queues.transferQueueFamilyIndex,
+        .dstQueueFamilyIndex = batch->queues.graphicsQueueFamilyIndex,
+        .buffer = dst,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
     };
+    batch->dstStageMask |= dstStageMask;
 
-    vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-    endSingleTimeCommands(device, queue, commandPool, commandBuffer);
-}
-
-VkBuffer createVertexBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool commandPool, VkDeviceMemory* outMemory)
-{
-    VkDeviceSize bufferSize = sizeof(g_vertices[0]) * g_vertexCount;
-
-    VkDeviceMemory stagingBufferMemory;
-    VkBuffer stagingBuffer = createBuffer(physicalDevice, device, &stagingBufferMemory, bufferSize,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    void* bufferData;
-    if (vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &bufferData) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to map vertex buffer memory");
-    memcpy(bufferData, g_vertices, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    VkBuffer buffer = createBuffer(physicalDevice, device, outMemory, bufferSize,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    copyBuffer(device, queue, commandPool, stagingBuffer, buffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
-
-    return buffer;
+    endProfileZone(zone);
 }
 
-VkBuffer createIndexBuffer(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool commandPool, VkDeviceMemory* outMemory)
+void recordImageLayoutTransition(VkCommandBuffer commandBuffer, VkImage image, u32 mipLevels, VkImageLayout oldLayout, VkImageLayout newLayout)
 {
-    VkDeviceSize bufferSize = sizeof(g_indices[0]) * g_indexCount;
-
-    VkDeviceMemory stagingBufferMemory;
-    VkBuffer stagingBuffer = createBuffer(physicalDevice, device, &stagingBufferMemory, bufferSize,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-
-    void* bufferData;
-    if (vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &bufferData) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to map index buffer memory");
-    memcpy(bufferData, g_indices, bufferSize);
-    vkUnmapMemory(device, stagingBufferMemory);
-
-    VkBuffer buffer = createBuffer(physicalDevice, device, outMemory, bufferSize,
-        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    copyBuffer(device, queue, commandPool, stagingBuffer, buffer, bufferSize);
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
-
-    return buffer;
-}
-
-void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkImage image, VkFormat format, VkImageLayout oldLayout, VkImageLayout newLayout) {
-    VkCommandBuffer commandBuffer = beginSingleTimeCommands(device, commandPool);
-
     VkImageMemoryBarrier imageMemoryBarrier = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
         .oldLayout = oldLayout,
@@ -843,7 +1409,7 @@ void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool command
         .subresourceRange = {
             .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
             .baseMipLevel = 0,
-            .levelCount = 1,
+            .levelCount = mipLevels,
             .baseArrayLayer = 0,
             .layerCount = 1
         }
@@ -872,20 +1438,405 @@ void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool command
     }
 
     vkCmdPipelineBarrier(commandBuffer, srcStageFlags, dstStageFlags, 0, 0, NULL, 0, NULL, 1, &imageMemoryBarrier);
+}
+
+// Uploads every level the texture holds, or only level 0 when
+// generateMipmaps is set and the rest of the chain is blitted from it
+void uploadImageData(UploadBatch* batch, VkImage image, const Texture* texture, u32 mipLevels, bool generateMipmaps)
+{
+    ASSERT(generateMipmaps || texture->mipLevelCount == mipLevels);
+    ProfileZone zone = beginProfileZone("upload image");
+
+    u32 width = texture->width;
+    u32 height = texture->height;
+    VkBuffer stagingBuffer = createStagingBuffer(batch, texture->data, texture->dataSize);
+
+    recordImageLayoutTransition(batch->commandBuffer, image, mipLevels, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+
+    u32 copyLevelCount = generateMipmaps ? 1 : mipLevels;
+    VkBufferImageCopy* regions = mallocOrDie(copyLevelCount * sizeof(VkBufferImageCopy));
+    for (u32 i = 0; i < copyLevelCount; i++)
+    {
+        u32 levelWidth = (width >> i > 0) ? width >> i : 1;
+        u32 levelHeight = (height >> i > 0) ? height >> i : 1;
+
+        // Extents of block compressed levels do not have to be a multiple of
+        // the block size, the copy covers the partial blocks at the edges
+        regions[i] = (VkBufferImageCopy){
+            .bufferOffset = texture->levelOffsets[i],
+            .imageSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = i,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            },
+            .imageExtent = {levelWidth, levelHeight, 1}
+        };
+
+        ASSERT(texture->levelOffsets[i] + getTextureLevelSize(texture->format, levelWidth, levelHeight) <= texture->dataSize);
+    }
+
+    vkCmdCopyBufferToImage(batch->commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyLevelCount, regions);
+    freeAndNull(regions);
+
+    if (batch->imageBarrierCount == MAX_UPLOAD_BARRIERS)
+        PANIC("%s\n", "Too many images in upload batch");
+
+    // Images with generated mipmaps stay in the transfer layout until the
+    // blits, which need a graphics queue, have run
+    batch->imageExtents[batch->imageBarrierCount] = (VkExtent2D){width, height};
+    batch->generateMipmaps[batch->imageBarrierCount] = generateMipmaps;
+    batch->imageBarriers[batch->imageBarrierCount++] = (VkImageMemoryBarrier){
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = generateMipmaps ? VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT : VK_ACCESS_SHADER_READ_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout = generateMipmaps ? VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL : VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        .srcQueueFamilyIndex = batch->queues.transferQueueFamilyIndex,
+        .dstQueueFamilyIndex = batch->queues.graphicsQueueFamilyIndex,
+        .image = image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = mipLevels,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+    batch->dstStageMask |= generateMipmaps ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+
+    endProfileZone(zone);
+}
+
+// Expects every level in TRANSFER_DST_OPTIMAL with level 0 filled, and
+// leaves the whole chain in SHADER_READ_ONLY_OPTIMAL
+static void recordMipmapGeneration(VkCommandBuffer commandBuffer, VkImage image, u32 width, u32 height, u32 mipLevels)
+{
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = image,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+
+    i32 levelWidth = (i32)width;
+    i32 levelHeight = (i32)height;
+    for (u32 i = 1; i < mipLevels; i++)
+    {
+        barrier.subresourceRange.baseMipLevel = i - 1;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+        i32 nextWidth = (levelWidth > 1) ? levelWidth / 2 : 1;
+        i32 nextHeight = (levelHeight > 1) ? levelHeight / 2 : 1;
+
+        VkImageBlit blit = {
+            .srcSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = i - 1,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            },
+            .srcOffsets = {{0, 0, 0}, {levelWidth, levelHeight, 1}},
+            .dstSubresource = {
+                .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+                .mipLevel = i,
+                .baseArrayLayer = 0,
+                .layerCount = 1
+            },
+            .dstOffsets = {{0, 0, 0}, {nextWidth, nextHeight, 1}}
+        };
+
+        vkCmdBlitImage(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+        barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+
+    barrier.subresourceRange.baseMipLevel = mipLevels - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+static void recordUploadedMipmapGeneration(const UploadBatch* batch, VkCommandBuffer commandBuffer)
+{
+    for (u32 i = 0; i < batch->imageBarrierCount; i++)
+        if (batch->generateMipmaps[i])
+            recordMipmapGeneration(commandBuffer, batch->imageBarriers[i].image, batch->imageExtents[i].width,
+                batch->imageExtents[i].height, batch->imageBarriers[i].subresourceRange.levelCount);
+}
+
+void submitUploadBatch(UploadBatch* batch)
+{
+    ProfileZone zone = beginProfileZone("submit upload batch");
+
+    VkPipelineStageFlags dstStageMask = (batch->dstStageMask != 0) ? batch->dstStageMask : VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    VkBufferMemoryBarrier* bufferBarriers = batch->bufferBarriers;
+    VkImageMemoryBarrier* imageBarriers = batch->imageBarriers;
+
+    // Only the graphics queue signals the timeline, so its values complete
+    // in order while the transfer queue runs alongside
+    GpuTimeline* timeline = batch->queues.timeline;
+    batch->timelineValue = advanceGpuTimeline(timeline);
+    VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .signalSemaphoreValueCount = 1,
+        .pSignalSemaphoreValues = &batch->timelineValue
+    };
+
+    if (!isQueueFamilyTransferNeeded(batch))
+    {
+        for (u32 i = 0; i < batch->bufferBarrierCount; i++)
+            bufferBarriers[i].srcQueueFamilyIndex = bufferBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        for (u32 i = 0; i < batch->imageBarrierCount; i++)
+            imageBarriers[i].srcQueueFamilyIndex = imageBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+        vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, dstStageMask, 0, 0, NULL,
+            batch->bufferBarrierCount, bufferBarriers, batch->imageBarrierCount, imageBarriers);
+        recordUploadedMipmapGeneration(batch, batch->commandBuffer);
+
+        if (vkEndCommandBuffer(batch->commandBuffer) != VK_SUCCESS)
+            PANIC("%s\n", "Failed to end command buffer for upload batch");
+
+        VkSubmitInfo submitInfo = {
+            .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+            .pNext = &timelineSubmitInfo,
+            .commandBufferCount = 1,
+            .pCommandBuffers = &batch->commandBuffer,
+            .signalSemaphoreCount = 1,
+            .pSignalSemaphores = &timeline->semaphore
+        };
+
+        if (vkQueueSubmit(batch->queues.graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+            PANIC("%s\n", "Failed to submit upload batch to queue");
+
+        endProfileZone(zone);
+        return;
+    }
+
+    // Release half of the ownership transfer, destination access is ignored
+    VkBufferMemoryBarrier releaseBufferBarriers[MAX_UPLOAD_BARRIERS];
+    VkImageMemoryBarrier releaseImageBarriers[MAX_UPLOAD_BARRIERS];
+    for (u32 i = 0; i < batch->bufferBarrierCount; i++)
+    {
+        releaseBufferBarriers[i] = bufferBarriers[i];
+        releaseBufferBarriers[i].dstAccessMask = 0;
+    }
+    for (u32 i = 0; i < batch->imageBarrierCount; i++)
+    {
+        releaseImageBarriers[i] = imageBarriers[i];
+        releaseImageBarriers[i].dstAccessMask = 0;
+    }
+
+    vkCmdPipelineBarrier(batch->commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL,
+        batch->bufferBarrierCount, releaseBufferBarriers, batch->imageBarrierCount, releaseImageBarriers);
+
+    if (vkEndCommandBuffer(batch->commandBuffer) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to end command buffer for upload batch");
+
+    // Acquire half, source access is ignored and the layout transition
+    // repeats the one in the release barrier
+    for (u32 i = 0; i < batch->bufferBarrierCount; i++)
+        bufferBarriers[i].srcAccessMask = 0;
+    for (u32 i = 0; i < batch->imageBarrierCount; i++)
+        imageBarriers[i].srcAccessMask = 0;
+
+    batch->acquireCommandBuffer = beginOneTimeCommandBuffer(batch->device, batch->queues.graphicsCommandPool);
+    vkCmdPipelineBarrier(batch->acquireCommandBuffer, dstStageMask, dstStageMask, 0, 0, NULL,
+        batch->bufferBarrierCount, bufferBarriers, batch->imageBarrierCount, imageBarriers);
+    recordUploadedMipmapGeneration(batch, batch->acquireCommandBuffer);
+
+    if (vkEndCommandBuffer(batch->acquireCommandBuffer) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to end command buffer for upload batch");
+
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    if (vkCreateSemaphore(batch->device, &semaphoreCreateInfo, NULL, &batch->transferFinishedSemaphore) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to create semaphore for upload batch");
+
+    VkSubmitInfo transferSubmitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch->commandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &batch->transferFinishedSemaphore
+    };
+
+    if (vkQueueSubmit(batch->queues.transferQueue, 1, &transferSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to submit upload batch to transfer queue");
+
+    // Frames submitted to the graphics queue after this are ordered behind
+    // the acquire barriers, earlier frames keep running during the copies
+    VkSubmitInfo acquireSubmitInfo = {
+        .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timelineSubmitInfo,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores = &batch->transferFinishedSemaphore,
+        .pWaitDstStageMask = &dstStageMask,
+        .commandBufferCount = 1,
+        .pCommandBuffers = &batch->acquireCommandBuffer,
+        .signalSemaphoreCount = 1,
+        .pSignalSemaphores = &timeline->semaphore
+    };
+
+    if (vkQueueSubmit(batch->queues.graphicsQueue, 1, &acquireSubmitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to submit upload batch to graphics queue");
+
+    endProfileZone(zone);
+}
 
-    endSingleTimeCommands(device, queue, commandPool, commandBuffer);
+// Releases the batch's staging memory and command buffers once the timeline
+// has reached its value. Returns false while the upload is still in flight
+// unless wait is set, in which case it blocks until completion.
+bool releaseUploadBatch(UploadBatch* batch, bool wait)
+{
+    if (batch->timelineValue == 0)
+        return true;
+
+    if (wait)
+        waitForGpuTimelineValue(batch->queues.timeline, batch->timelineValue);
+    else if (!isGpuTimelineValueComplete(batch->queues.timeline, batch->timelineValue))
+        return false;
+
+    for (u32 i = 0; i < batch->stagingBufferCount; i++)
+    {
+        vkDestroyBuffer(batch->device, batch->stagingBuffers[i].buffer, NULL);
+        freeGpuMemory(batch->allocator, &batch->stagingBuffers[i].allocation);
+    }
+
+    freeAndNull(batch->stagingBuffers);
+    batch->stagingBufferCount = 0;
+    batch->stagingBufferCapacity = 0;
+
+    vkFreeCommandBuffers(batch->device, batch->queues.transferCommandPool, 1, &batch->commandBuffer);
+    if (batch->acquireCommandBuffer != VK_NULL_HANDLE)
+        vkFreeCommandBuffers(batch->device, batch->queues.graphicsCommandPool, 1, &batch->acquireCommandBuffer);
+    if (batch->transferFinishedSemaphore != VK_NULL_HANDLE)
+        vkDestroySemaphore(batch->device, batch->transferFinishedSemaphore, NULL);
+    batch->timelineValue = 0;
+
+    return true;
+}
+
+VkBuffer createVertexBuffer(VkDevice device, UploadBatch* uploadBatch, const Model* model, GpuAllocation* outAllocation)
+{
+    VkDeviceSize bufferSize = sizeof(model->vertices[0]) * model->vertexCount;
+
+    VkBuffer buffer = createBuffer(uploadBatch->allocator, device, outAllocation, bufferSize,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_CATEGORY_VERTEX);
+
+    uploadBufferData(uploadBatch, buffer, model->vertices, bufferSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+    return buffer;
+}
+
+VkBuffer createIndexBuffer(VkDevice device, UploadBatch* uploadBatch, const Model* model, GpuAllocation* outAllocation)
+{
+    VkDeviceSize bufferSize = sizeof(model->indices[0]) * model->indexCount;
+
+    VkBuffer buffer = createBuffer(uploadBatch->allocator, device, outAllocation, bufferSize,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_CATEGORY_INDEX);
+
+    uploadBufferData(uploadBatch, buffer, model->indices, bufferSize, VK_ACCESS_INDEX_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+
+    return buffer;
+}
+
+// Positions alone, so the depth pre-pass fetches 12 bytes per vertex
+// instead of the whole interleaved vertex
+VkBuffer createPositionBuffer(VkDevice device, UploadBatch* uploadBatch, const Model* model, GpuAllocation* outAllocation)
+{
+    VkDeviceSize bufferSize = sizeof(Vec3) * model->vertexCount;
+    Vec3* positions = mallocOrDie(bufferSize);
+    for (u32 i = 0; i < model->vertexCount; i++)
+        positions[i] = model->vertices[i].pos;
+
+    VkBuffer buffer = createBuffer(uploadBatch->allocator, device, outAllocation, bufferSize,
+        VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_CATEGORY_VERTEX);
+
+    uploadBufferData(uploadBatch, buffer, positions, bufferSize, VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    freeAndNull(positions);
+
+    return buffer;
+}
+
+typedef struct
+{
+    VkBuffer vertexBuffer;
+    GpuAllocation vertexBufferAllocation;
+    VkBuffer indexBuffer;
+    GpuAllocation indexBufferAllocation;
+    // Only created for the depth pre-pass
+    VkBuffer positionBuffer;
+    GpuAllocation positionBufferAllocation;
+    bool closed;
+} MeshBuffers;
+
+// Device memory the buffers of a model take, which is also the staging
+// memory needed to upload them
+static VkDeviceSize getMeshBuffersSize(const Model* model, bool positionStream)
+{
+    VkDeviceSize size = sizeof(model->vertices[0]) * model->vertexCount + sizeof(model->indices[0]) * model->indexCount;
+    if (positionStream)
+        size += sizeof(Vec3) * model->vertexCount;
+    return size;
+}
+
+static void createMeshBuffers(VkDevice device, UploadBatch* uploadBatch, const Model* model, bool positionStream, MeshBuffers* outMesh)
+{
+    outMesh->closed = model->closed;
+    outMesh->vertexBuffer = createVertexBuffer(device, uploadBatch, model, &outMesh->vertexBufferAllocation);
+    outMesh->indexBuffer = createIndexBuffer(device, uploadBatch, model, &outMesh->indexBufferAllocation);
+    outMesh->positionBuffer = VK_NULL_HANDLE;
+    if (positionStream)
+        outMesh->positionBuffer = createPositionBuffer(device, uploadBatch, model, &outMesh->positionBufferAllocation);
+}
+
+static void destroyMeshBuffers(GpuAllocator* allocator, VkDevice device, MeshBuffers* mesh)
+{
+    if (mesh->vertexBuffer == VK_NULL_HANDLE)
+        return;
+
+    vkDestroyBuffer(device, mesh->indexBuffer, NULL);
+    freeGpuMemory(allocator, &mesh->indexBufferAllocation);
+    vkDestroyBuffer(device, mesh->vertexBuffer, NULL);
+    freeGpuMemory(allocator, &mesh->vertexBufferAllocation);
+    if (mesh->positionBuffer != VK_NULL_HANDLE)
+    {
+        vkDestroyBuffer(device, mesh->positionBuffer, NULL);
+        freeGpuMemory(allocator, &mesh->positionBufferAllocation);
+    }
+    *mesh = (MeshBuffers){0};
 }
 
-VkImage createImage(VkPhysicalDevice physicalDevice, VkDevice device, u32 width, u32 height, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties, VkDeviceMemory* outImageMemory)
+VkImage createImage(GpuAllocator* allocator, VkDevice device, u32 width, u32 height, u32 mipLevels, VkFormat format, VkImageTiling tiling, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+    GpuMemoryCategory category, GpuAllocation* outImageAllocation)
 {
-    ASSERT(outImageMemory != NULL);
+    ASSERT(outImageAllocation != NULL);
 
     VkImageCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
         .imageType = VK_IMAGE_TYPE_2D,
         .format = format,
         .extent = {width, height, 1},
-        .mipLevels = 1,
+        .mipLevels = mipLevels,
         .arrayLayers = 1,
         .samples = VK_SAMPLE_COUNT_1_BIT,
         .tiling = tiling,
@@ -898,50 +1849,143 @@ VkImage createImage(VkPhysicalDevice physicalDevice, VkDevice device, u32 width,
     if (vkCreateImage(device, &createInfo, NULL, &image) != VK_SUCCESS)
         PANIC("%s\n", "Failed to create texture image");
 
-    VkMemoryRequirements memoryRequirements;
-    vkGetImageMemoryRequirements(device, image, &memoryRequirements);
+    *outImageAllocation = allocateAndBindImageMemory(allocator, image, tiling, properties, category);
 
-    VkMemoryAllocateInfo memoryAllocateInfo = {
-        .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-        .allocationSize = memoryRequirements.size,
-        .memoryTypeIndex = pickMemoryType(physicalDevice, memoryRequirements.memoryTypeBits, properties)
-    };
+    return image;
+}
+
+static bool isLinearBlitSupported(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
 
-    if (vkAllocateMemory(device, &memoryAllocateInfo, NULL, outImageMemory) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to allocate memory for texture image");
+    VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
+}
 
-    if (vkBindImageMemory(device, image, *outImageMemory, 0) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to bind image memory for texture image");
-    
-    return image;
+static bool isSampledFormatSupported(VkPhysicalDevice physicalDevice, VkFormat format)
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &formatProperties);
+
+    VkFormatFeatureFlags requiredFeatures = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    return (formatProperties.optimalTilingFeatures & requiredFeatures) == requiredFeatures;
 }
 
-VkImage createTextureImage(VkPhysicalDevice physicalDevice, VkDevice device, VkQueue queue, VkCommandPool commandPool, VkDeviceMemory* outImageMemory)
+// Whether resources of deviceLocalBytes, uploaded through stagingBytes of
+// staging memory, stay within the budgets of the heaps they come from
+static bool fitsGpuMemoryBudget(const GpuAllocator* allocator, VkDeviceSize deviceLocalBytes, VkDeviceSize stagingBytes)
 {
-    VkDeviceSize imageSize = g_textureDataWidth * g_textureDataHeight * 4;
-    VkDeviceMemory stagingBufferMemory;
-    VkBuffer stagingBuffer = createBuffer(physicalDevice, device, &stagingBufferMemory, imageSize,
-        VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-    
-    void* data;
-    if (vkMapMemory(device, stagingBufferMemory, 0, imageSize, 0, &data) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to map memory for texture image");
-    memcpy(data, g_textureData, imageSize);
-    vkUnmapMemory(device, stagingBufferMemory);
+    u32 deviceLocalHeapIndex;
+    u32 stagingHeapIndex;
+    VkDeviceSize deviceLocalHeadroom = getGpuMemoryHeadroom(allocator, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &deviceLocalHeapIndex);
+    VkDeviceSize stagingHeadroom = getGpuMemoryHeadroom(allocator, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingHeapIndex);
+
+    if (deviceLocalHeapIndex == stagingHeapIndex)
+        return deviceLocalBytes + stagingBytes <= deviceLocalHeadroom;
+
+    return deviceLocalBytes <= deviceLocalHeadroom && stagingBytes <= stagingHeadroom;
+}
+
+static VkDeviceSize getMipChainSize(VkFormat format, u32 width, u32 height, u32 firstLevel, u32 levelCount)
+{
+    VkDeviceSize size = 0;
+    for (u32 i = firstLevel; i < levelCount; i++)
+        size += getTextureLevelSize(format, (width >> i > 0) ? width >> i : 1, (height >> i > 0) ? height >> i : 1);
+    return size;
+}
+
+VkImage createTextureImage(VkPhysicalDevice physicalDevice, VkDevice device, UploadBatch* uploadBatch, const Texture* texture, GpuAllocation* outImageAllocation,
+    VkFormat* outFormat, u32* outMipLevels)
+{
+    ProfileZone zone = beginProfileZone("create texture image");
+
+    // Compressed data the device cannot sample is expanded to RGBA8 instead
+    Texture decodedTexture = {0};
+    if (isCompressedTextureFormat(texture->format) && !isSampledFormatSupported(physicalDevice, texture->format))
+    {
+        INFORM("%s\n", "Compressed texture format is not supported by the device, decoding on the CPU");
+        decodeTexture(texture, &decodedTexture);
+        texture = &decodedTexture;
+    }
+
+    VkFormat format = texture->format;
+    bool generateMipmaps = false;
+    u32 mipLevels = texture->mipLevelCount;
+
+    // Uncompressed textures without their own mip chain get a full one,
+    // blitted on the GPU when the format allows it
+    Texture mipChainTexture = {0};
+    if (!isCompressedTextureFormat(format) && texture->mipLevelCount == 1)
+    {
+        mipLevels = getFullMipLevelCount(texture->width, texture->height);
+        if (isLinearBlitSupported(physicalDevice, format))
+        {
+            generateMipmaps = true;
+        }
+        else
+        {
+            INFORM("%s\n", "Texture format does not support linear blits, building mipmaps on the CPU");
+            generateTextureMipChain(texture, &mipChainTexture);
+            texture = &mipChainTexture;
+        }
+    }
+
+    // Textures too large for the memory budget lose their largest levels
+    // instead of failing to allocate
+    u32 droppedLevelCount = 0;
+    while (droppedLevelCount + 1 < mipLevels)
+    {
+        VkDeviceSize imageBytes = getMipChainSize(format, texture->width, texture->height, droppedLevelCount, mipLevels);
+        VkDeviceSize stagingBytes = (generateMipmaps && droppedLevelCount == 0)
+            ? getTextureLevelSize(format, texture->width, texture->height) : imageBytes;
+        if (fitsGpuMemoryBudget(uploadBatch->allocator, imageBytes, stagingBytes))
+            break;
+        droppedLevelCount++;
+    }
+
+    Texture reducedTexture = {0};
+    if (droppedLevelCount > 0)
+    {
+        INFORM("%s%u%s\n", "Texture exceeds the GPU memory budget, dropping ", droppedLevelCount, " mip levels");
+
+        // The dropped levels are only known on the CPU side
+        if (generateMipmaps)
+        {
+            generateTextureMipChain(texture, &mipChainTexture);
+            texture = &mipChainTexture;
+            generateMipmaps = false;
+        }
+
+        copyTextureMipLevels(texture, droppedLevelCount, &reducedTexture);
+        texture = &reducedTexture;
+        mipLevels -= droppedLevelCount;
+    }
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (generateMipmaps)
+        usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+
+    VkImage textureImage = createImage(uploadBatch->allocator, device, texture->width, texture->height, mipLevels, format, VK_IMAGE_TILING_OPTIMAL,
+        usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_CATEGORY_TEXTURE, outImageAllocation);
 
-    VkImage textureImage = createImage(physicalDevice, device, g_textureDataWidth, g_textureDataHeight, VK_FORMAT_R8G8B8A8_SRGB,
-        VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, outImageMemory);
-    transitionImageLayout(device, queue, commandPool, textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    copyBufferToImage(device, queue, commandPool, stagingBuffer, textureImage, g_textureDataWidth, g_textureDataHeight);
-    transitionImageLayout(device, queue, commandPool, textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // The staging copy is taken here, so the CPU side data can go right away
+    uploadImageData(uploadBatch, textureImage, texture, mipLevels, generateMipmaps);
 
-    vkDestroyBuffer(device, stagingBuffer, NULL);
-    vkFreeMemory(device, stagingBufferMemory, NULL);
+    freeTexture(&decodedTexture);
+    freeTexture(&mipChainTexture);
+    freeTexture(&reducedTexture);
 
+    if (outFormat != NULL)
+        *outFormat = format;
+    if (outMipLevels != NULL)
+        *outMipLevels = mipLevels;
+
+    endProfileZone(zone);
     return textureImage;
 }
 
-VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, u32 mipLevels)
 {
     VkImageViewCreateInfo createInfo = {
         .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -950,7 +1994,7 @@ VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkI
         .format = format,
         .subresourceRange = {
             .aspectMask = aspectFlags,
-            .levelCount = 1,
+            .levelCount = mipLevels,
             .layerCount = 1
         }
     };
@@ -962,7 +2006,7 @@ VkImageView createImageView(VkDevice device, VkImage image, VkFormat format, VkI
     return imageView;
 }
 
-VkSampler createTextureSampler(VkPhysicalDevice physicalDevice, VkDevice device)
+VkSampler createTextureSampler(VkPhysicalDevice physicalDevice, VkDevice device, bool anisotropyEnabled)
 {
     VkPhysicalDeviceProperties physicalDeviceProperties;
     vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
@@ -974,8 +2018,8 @@ VkSampler createTextureSampler(VkPhysicalDevice physicalDevice, VkDevice device)
         .addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT,
         .addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT,
         .addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT,
-        .anisotropyEnable = VK_TRUE,
-        .maxAnisotropy = physicalDeviceProperties.limits.maxSamplerAnisotropy,
+        .anisotropyEnable = anisotropyEnabled,
+        .maxAnisotropy = anisotropyEnabled ? physicalDeviceProperties.limits.maxSamplerAnisotropy : 1.0f,
         .borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
         .unnormalizedCoordinates = VK_FALSE,
         .compareEnable = VK_FALSE,
@@ -983,7 +2027,7 @@ VkSampler createTextureSampler(VkPhysicalDevice physicalDevice, VkDevice device)
         .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
         .mipLodBias = 0.0f,
         .minLod = 0.0f,
-        .maxLod = 0.0f
+        .maxLod = VK_LOD_CLAMP_NONE
     };
 
     VkSampler textureSampler;
@@ -995,160 +2039,1322 @@ VkSampler createTextureSampler(VkPhysicalDevice physicalDevice, VkDevice device)
 
 typedef struct
 {
-    Mat4 model;
-    Mat4 view;
-    Mat4 proj;
+    Mat4 mvp;
     f32 colorToTextureRatio;
 } UniformBufferObject;
 
-void createUniformBuffers(VkPhysicalDevice physicalDevice, VkDevice device, VkBuffer uniformBuffers[], VkDeviceMemory uniformBuffersMemory[], void* uniformBuffersMapped[])
+void createUniformBuffers(GpuAllocator* allocator, VkDevice device, u32 count, VkBuffer uniformBuffers[], GpuAllocation uniformBuffersAllocations[], void* uniformBuffersMapped[])
 {
     ASSERT(uniformBuffers != NULL);
-    ASSERT(uniformBuffersMemory != NULL);
+    ASSERT(uniformBuffersAllocations != NULL);
     ASSERT(uniformBuffersMapped != NULL);
 
     VkDeviceSize bufferSize = sizeof(UniformBufferObject);
 
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    for (u32 i = 0; i < count; i++)
+    {
+        uniformBuffers[i] = createBuffer(allocator, device, &uniformBuffersAllocations[i], bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, GPU_MEMORY_CATEGORY_OTHER);
+        uniformBuffersMapped[i] = uniformBuffersAllocations[i].mapped;
+    }
+}
+
+// Color images rendered into instead of a swapchain, one per frame in flight
+// so a frame can be read back or upscaled while the next one renders
+typedef struct
+{
+    VkExtent2D extent;
+    u32 slotCount;
+    VkImage colorImages[MAX_FRAMES_IN_FLIGHT];
+    GpuAllocation colorImageAllocations[MAX_FRAMES_IN_FLIGHT];
+    VkImageView colorImageViews[MAX_FRAMES_IN_FLIGHT];
+    VkFramebuffer* framebuffers;
+
+    // Only set up when frames are dumped
+    bool readback;
+    VkBuffer readbackBuffers[MAX_FRAMES_IN_FLIGHT];
+    GpuAllocation readbackBufferAllocations[MAX_FRAMES_IN_FLIGHT];
+    VkCommandBuffer readbackCommandBuffers[MAX_FRAMES_IN_FLIGHT];
+    // Timeline value of the submission that last read back into the slot, 0
+    // when it has been written out
+    u64 readbackTimelineValues[MAX_FRAMES_IN_FLIGHT];
+    u64 readbackFrameNumbers[MAX_FRAMES_IN_FLIGHT];
+} OffscreenTarget;
+
+static void recordReadbackCommandBuffer(VkCommandBuffer commandBuffer, VkImage image, VkBuffer buffer, VkExtent2D extent)
+{
+    VkCommandBufferBeginInfo beginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to begin recording readback command buffer");
+
+    // The render pass has already moved the image to TRANSFER_SRC_OPTIMAL
+    VkBufferImageCopy region = {
+        .bufferOffset = 0,
+        .imageSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        },
+        .imageExtent = {extent.width, extent.height, 1}
+    };
+    vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+    VkBufferMemoryBarrier bufferMemoryBarrier = {
+        .sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer = buffer,
+        .offset = 0,
+        .size = VK_WHOLE_SIZE
+    };
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0, NULL, 1, &bufferMemoryBarrier, 0, NULL);
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to record readback command buffer");
+}
+
+static void createOffscreenTarget(GpuAllocator* allocator, VkDevice device, VkCommandPool commandPool, VkRenderPass renderPass, VkExtent2D extent,
+    u32 slotCount, VkImageView depthImageView, bool readback, OffscreenTarget* outTarget)
+{
+    ASSERT(slotCount > 0 && slotCount <= MAX_FRAMES_IN_FLIGHT);
+
+    *outTarget = (OffscreenTarget){
+        .extent = extent,
+        .slotCount = slotCount,
+        .readback = readback
+    };
+
+    for (u32 i = 0; i < slotCount; i++)
     {
-        uniformBuffers[i] = createBuffer(physicalDevice, device, &uniformBuffersMemory[i], bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
-        if (vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]) != VK_SUCCESS)
-            PANIC("%s\n", "Failed to map uniform buffer memory");
+        outTarget->colorImages[i] = createImage(allocator, device, extent.width, extent.height, 1, OFFSCREEN_COLOR_FORMAT, VK_IMAGE_TILING_OPTIMAL,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_CATEGORY_ATTACHMENT,
+            &outTarget->colorImageAllocations[i]);
+        outTarget->colorImageViews[i] = createImageView(device, outTarget->colorImages[i], OFFSCREEN_COLOR_FORMAT, VK_IMAGE_ASPECT_COLOR_BIT, 1);
+    }
+
+    // Dynamic rendering passes renderPass as VK_NULL_HANDLE
+    if (renderPass != VK_NULL_HANDLE)
+        outTarget->framebuffers = createSwapchainFramebuffers(device, outTarget->colorImageViews, slotCount, extent, renderPass, depthImageView);
+
+    if (!readback)
+        return;
+
+    VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = slotCount
+    };
+
+    if (vkAllocateCommandBuffers(device, &allocateInfo, outTarget->readbackCommandBuffers) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to allocate readback command buffers");
+
+    VkDeviceSize readbackSize = (VkDeviceSize)extent.width * extent.height * 4;
+    for (u32 i = 0; i < slotCount; i++)
+    {
+        outTarget->readbackBuffers[i] = createBuffer(allocator, device, &outTarget->readbackBufferAllocations[i], readbackSize,
+            VK_BUFFER_USAGE_TRANSFER_DST_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, GPU_MEMORY_CATEGORY_OTHER);
+        recordReadbackCommandBuffer(outTarget->readbackCommandBuffers[i], outTarget->colorImages[i], outTarget->readbackBuffers[i], extent);
+    }
+}
+
+// The caller must make sure the device no longer uses the target
+static void destroyOffscreenTarget(GpuAllocator* allocator, VkDevice device, VkCommandPool commandPool, OffscreenTarget* target)
+{
+    for (u32 i = 0; i < target->slotCount; i++)
+    {
+        if (target->framebuffers != NULL)
+            vkDestroyFramebuffer(device, target->framebuffers[i], NULL);
+        vkDestroyImageView(device, target->colorImageViews[i], NULL);
+        vkDestroyImage(device, target->colorImages[i], NULL);
+        freeGpuMemory(allocator, &target->colorImageAllocations[i]);
+    }
+    freeAndNull(target->framebuffers);
+
+    if (!target->readback)
+        return;
+
+    vkFreeCommandBuffers(device, commandPool, target->slotCount, target->readbackCommandBuffers);
+    for (u32 i = 0; i < target->slotCount; i++)
+    {
+        vkDestroyBuffer(device, target->readbackBuffers[i], NULL);
+        freeGpuMemory(allocator, &target->readbackBufferAllocations[i]);
+    }
+}
+
+// Writes the frame last read back into this slot as a binary PPM, waiting
+// for its submission to complete first
+static void writeReadbackFrame(OffscreenTarget* target, u32 slot, GpuTimeline* timeline, const char* directory)
+{
+    if (target->readbackTimelineValues[slot] == 0)
+        return;
+
+    waitForGpuTimelineValue(timeline, target->readbackTimelineValues[slot]);
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/frame_%05llu.ppm", directory, (unsigned long long)target->readbackFrameNumbers[slot]);
+
+    FILE* file = fopen(path, "wb");
+    if (file == NULL)
+        PANIC("%s%s\n", "Failed to open frame dump file: ", path);
+
+    u32 width = target->extent.width;
+    u32 height = target->extent.height;
+    fprintf(file, "P6\n%u %u\n255\n", width, height);
+
+    // The color format is RGBA8, PPM only stores RGB
+    const u8* pixels = target->readbackBufferAllocations[slot].mapped;
+    u8* row = mallocOrDie((usize)width * 3);
+    for (u32 y = 0; y < height; y++)
+    {
+        for (u32 x = 0; x < width; x++)
+            memcpy(&row[x * 3], &pixels[((usize)y * width + x) * 4], 3);
+
+        if (fwrite(row, 1, (usize)width * 3, file) != (usize)width * 3)
+            PANIC("%s%s\n", "Failed to write frame dump file: ", path);
+    }
+    freeAndNull(row);
+
+    if (fclose(file) != 0)
+        PANIC("%s%s\n", "Failed to write frame dump file: ", path);
+
+    target->readbackTimelineValues[slot] = 0;
+}
+
+// View and projection only change on resize or camera movement, so their
+// product is cached and rebuilt only when the camera has been marked dirty.
+static void updateCameraMatrices(Camera* camera, VkExtent2D surfaceExtent)
+{
+    if (camera->extent.width != surfaceExtent.width || camera->extent.height != surfaceExtent.height)
+    {
+        camera->extent = surfaceExtent;
+        camera->dirty = true;
+    }
+
+    if (!camera->dirty)
+        return;
+
+    Mat4 view = LookAtRH(camera->eye, camera->target, camera->up);
+    Mat4 proj = perspectiveRH(camera->fov, surfaceExtent.width / (f32)surfaceExtent.height, 0.1f, 100.0f);
+    proj.elements[1][1] *= -1;
+
+    camera->viewProj = mulMat4(proj, view);
+    camera->dirty = false;
+}
+
+// Headless and benchmark runs advance by a fixed step per frame so their
+// frames are reproducible regardless of how fast the device renders.
+// Otherwise animation follows wall time since startTime.
+// A nonzero pauseStartTime freezes the animation at that moment
+static f32 getAnimationTime(bool fixedStep, u64 frameNumber, u64 startTime, u64 pauseStartTime)
+{
+    if (fixedStep)
+        return frameNumber * FIXED_FRAME_TIME;
+
+    u64 now = (pauseStartTime != 0) ? pauseStartTime : getTimeNanoseconds();
+    return (f32)nanosecondsToSeconds(now - startTime);
+}
+
+static bool isColorTransitionActive(void)
+{
+    return g_showTexture ? g_colorToTextureRatio < 1.0f : g_colorToTextureRatio > 0.0f;
+}
+
+void updateUniformBuffer(void* uniformBuffersMapped[], VkExtent2D surfaceExtent, u32 currentImage, f32 time)
+{
+    updateCameraMatrices(&g_camera, surfaceExtent);
+
+    Mat4 model = mulMat4(translate((Vec3){g_modelX, g_modelY, g_modelZ}), rotateRH(time, (Vec3){0.0f, 1.0f, 0.0f}));
+
+    UniformBufferObject ubo = {
+        .mvp = mulMat4(g_camera.viewProj, model),
+        .colorToTextureRatio = g_colorToTextureRatio
+    };
+
+    memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
+}
+
+typedef struct
+{
+    VkRenderPass renderPass;
+    VkFramebuffer framebuffer;
+    VkExtent2D extent;
+    VkViewport viewport;
+    VkRect2D scissor;
+    VkPipeline pipeline;
+    VkPipelineLayout pipelineLayout;
+    VkDescriptorSet descriptorSet;
+    VkBuffer vertexBuffer;
+    VkBuffer indexBuffer;
+    GpuQueries* gpuQueries;
+
+    // VK_NULL_HANDLE unless the render pass starts with a depth pre-pass
+    VkPipeline depthPrepassPipeline;
+    VkBuffer positionBuffer;
+
+    // Without a render pass the frame is drawn with dynamic rendering
+    // straight into these attachments
+    VkImage colorImage;
+    VkImageView colorImageView;
+    VkFormat colorFormat;
+    VkImageLayout colorFinalLayout;
+    VkImage depthImage;
+    VkImageView depthImageView;
+    VkFormat depthFormat;
+
+    // With dynamic resolution the scene is rendered into the top left
+    // extent of upscaleSource and stretched over upscaleTarget
+    VkImage upscaleSource;
+    VkImage upscaleTarget;
+    VkExtent2D upscaleTargetExtent;
+} FrameRecordInfo;
+
+// Secondary command buffers recorded in parallel, one per worker and frame in
+// flight. Each worker owns its command pools so no pool is touched by more
+// than one thread.
+typedef struct
+{
+    VkDevice device;
+    WorkerPool* workerPool;
+    u32 threadCount;
+    u32 frameCount;
+    VkCommandPool commandPools[MAX_FRAMES_IN_FLIGHT][MAX_RECORD_THREADS];
+    VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT][MAX_RECORD_THREADS];
+
+    const FrameRecordInfo* frameInfo;
+    u32 currentFrame;
+} ParallelRecorder;
+
+static void recordDrawCommands(VkCommandBuffer commandBuffer, const FrameRecordInfo* frameInfo, const DrawCommand* drawCommands, u32 drawCommandCount)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, frameInfo->pipeline);
+    vkCmdSetViewport(commandBuffer, 0, 1, &frameInfo->viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &frameInfo->scissor);
+
+    VkBuffer vertexBuffers[] = {frameInfo->vertexBuffer};
+    VkDeviceSize vertexBufferOffsets[] = {0};
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, vertexBufferOffsets);
+    vkCmdBindIndexBuffer(commandBuffer, frameInfo->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, frameInfo->pipelineLayout, 0, 1, &frameInfo->descriptorSet, 0, NULL);
+    for (u32 i = 0; i < drawCommandCount; i++)
+        vkCmdDrawIndexed(commandBuffer, drawCommands[i].indexCount, 1, drawCommands[i].firstIndex, 0, 0);
+}
+
+static void recordDepthPrepassCommands(VkCommandBuffer commandBuffer, const FrameRecordInfo* frameInfo)
+{
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, frameInfo->depthPrepassPipeline);
+    vkCmdSetViewport(commandBuffer, 0, 1, &frameInfo->viewport);
+    vkCmdSetScissor(commandBuffer, 0, 1, &frameInfo->scissor);
+
+    VkDeviceSize positionBufferOffset = 0;
+    vkCmdBindVertexBuffers(commandBuffer, 0, 1, &frameInfo->positionBuffer, &positionBufferOffset);
+    vkCmdBindIndexBuffer(commandBuffer, frameInfo->indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, frameInfo->pipelineLayout, 0, 1, &frameInfo->descriptorSet, 0, NULL);
+    for (u32 i = 0; i < g_drawCommandCount; i++)
+        vkCmdDrawIndexed(commandBuffer, g_drawCommands[i].indexCount, 1, g_drawCommands[i].firstIndex, 0, 0);
+}
+
+static void createParallelRecorder(ParallelRecorder* recorder, VkDevice device, u32 queueFamilyIndex, u32 threadCount, u32 frameCount)
+{
+    ASSERT(threadCount > 0 && threadCount <= MAX_RECORD_THREADS);
+    ASSERT(frameCount > 0 && frameCount <= MAX_FRAMES_IN_FLIGHT);
+
+    *recorder = (ParallelRecorder){
+        .device = device,
+        .threadCount = threadCount,
+        .frameCount = frameCount
+    };
+
+    VkCommandPoolCreateInfo commandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = queueFamilyIndex
+    };
+
+    for (u32 i = 0; i < frameCount; i++)
+    {
+        for (u32 j = 0; j < threadCount; j++)
+        {
+            if (vkCreateCommandPool(device, &commandPoolCreateInfo, NULL, &recorder->commandPools[i][j]) != VK_SUCCESS)
+                PANIC("%s\n", "Failed to create recording thread command pool");
+
+            VkCommandBufferAllocateInfo allocateInfo = {
+                .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+                .commandPool = recorder->commandPools[i][j],
+                .level = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+                .commandBufferCount = 1
+            };
+
+            if (vkAllocateCommandBuffers(device, &allocateInfo, &recorder->commandBuffers[i][j]) != VK_SUCCESS)
+                PANIC("%s\n", "Failed to allocate secondary command buffer");
+        }
+    }
+
+    recorder->workerPool = createWorkerPool(threadCount);
+}
+
+static void destroyParallelRecorder(ParallelRecorder* recorder)
+{
+    destroyWorkerPool(recorder->workerPool);
+    recorder->workerPool = NULL;
+
+    for (u32 i = 0; i < recorder->frameCount; i++)
+        for (u32 j = 0; j < recorder->threadCount; j++)
+            vkDestroyCommandPool(recorder->device, recorder->commandPools[i][j], NULL);
+}
+
+static void recordSecondaryCommandBuffer(u32 workerIndex, void* userData)
+{
+    ParallelRecorder* recorder = userData;
+    const FrameRecordInfo* frameInfo = recorder->frameInfo;
+    VkCommandBuffer commandBuffer = recorder->commandBuffers[recorder->currentFrame][workerIndex];
+    ProfileZone zone = beginProfileZone("record secondary");
+
+    if (vkResetCommandPool(recorder->device, recorder->commandPools[recorder->currentFrame][workerIndex], 0) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to reset recording thread command pool");
+
+    VkCommandBufferInheritanceRenderingInfo inheritanceRenderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &frameInfo->colorFormat,
+        .depthAttachmentFormat = frameInfo->depthFormat,
+        .rasterizationSamples = VK_SAMPLE_COUNT_1_BIT
+    };
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = (frameInfo->renderPass == VK_NULL_HANDLE) ? &inheritanceRenderingInfo : NULL,
+        .renderPass = frameInfo->renderPass,
+        .subpass = (frameInfo->renderPass != VK_NULL_HANDLE && frameInfo->depthPrepassPipeline != VK_NULL_HANDLE) ? 1 : 0,
+        .framebuffer = frameInfo->framebuffer,
+        .pipelineStatistics = getGpuPipelineStatisticFlags(frameInfo->gpuQueries)
+    };
+
+    VkCommandBufferBeginInfo beginInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT,
+        .pInheritanceInfo = &inheritanceInfo
+    };
+
+    if (vkBeginCommandBuffer(commandBuffer, &beginInfo) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to begin secondary command buffer");
+
+    u32 drawsPerThread = (g_drawCommandCount + recorder->threadCount - 1) / recorder->threadCount;
+    u32 firstDraw = workerIndex * drawsPerThread;
+    if (firstDraw < g_drawCommandCount)
+    {
+        u32 drawCount = g_drawCommandCount - firstDraw;
+        drawCount = (drawCount < drawsPerThread) ? drawCount : drawsPerThread;
+        recordDrawCommands(commandBuffer, frameInfo, g_drawCommands + firstDraw, drawCount);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to end secondary command buffer");
+
+    endProfileZone(zone);
+}
+
+// The source is left in TRANSFER_SRC_OPTIMAL by the render pass, the target
+// is a freshly acquired swapchain image and ends up ready to present
+static void recordUpscaleBlit(VkCommandBuffer commandBuffer, const FrameRecordInfo* frameInfo)
+{
+    VkImageMemoryBarrier barrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .srcAccessMask = 0,
+        .dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+        .newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = frameInfo->upscaleTarget,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = 0,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        }
+    };
+
+    // Chains onto the acquire semaphore wait, which covers the transfer stage
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    VkImageBlit blit = {
+        .srcSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        },
+        .srcOffsets = {{0, 0, 0}, {(i32)frameInfo->extent.width, (i32)frameInfo->extent.height, 1}},
+        .dstSubresource = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .mipLevel = 0,
+            .baseArrayLayer = 0,
+            .layerCount = 1
+        },
+        .dstOffsets = {{0, 0, 0}, {(i32)frameInfo->upscaleTargetExtent.width, (i32)frameInfo->upscaleTargetExtent.height, 1}}
+    };
+
+    vkCmdBlitImage(commandBuffer, frameInfo->upscaleSource, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        frameInfo->upscaleTarget, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit, VK_FILTER_LINEAR);
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+}
+
+static void recordRenderPassScene(VkCommandBuffer commandBuffer, const FrameRecordInfo* frameInfo, ParallelRecorder* recorder, u32 currentFrame)
+{
+    VkClearValue clearValues[] = {{.color = {0.f, 0.f, 0.f, 1.f}}, {.depthStencil = {1.0f, 0}}};
+    VkRenderPassBeginInfo renderPassBeginInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        .renderPass = frameInfo->renderPass,
+        .framebuffer = frameInfo->framebuffer,
+        .renderArea = {
+            .offset = {0, 0},
+            .extent = frameInfo->extent
+        },
+        .clearValueCount = ARR_LEN(clearValues),
+        .pClearValues = clearValues
+    };
+
+    VkSubpassContents colorSubpassContents = (recorder != NULL) ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS : VK_SUBPASS_CONTENTS_INLINE;
+
+    if (frameInfo->depthPrepassPipeline != VK_NULL_HANDLE)
+    {
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+        beginGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_DEPTH_PREPASS);
+        recordDepthPrepassCommands(commandBuffer, frameInfo);
+        endGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_DEPTH_PREPASS);
+        // The color subpass may only execute secondaries, so its timing
+        // starts at the end of the pre-pass subpass
+        beginGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_SCENE);
+        vkCmdNextSubpass(commandBuffer, colorSubpassContents);
+    }
+    else
+    {
+        beginGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_SCENE);
+        vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, colorSubpassContents);
+    }
+
+    if (recorder != NULL)
+        vkCmdExecuteCommands(commandBuffer, recorder->threadCount, recorder->commandBuffers[currentFrame]);
+    else
+        recordDrawCommands(commandBuffer, frameInfo, g_drawCommands, g_drawCommandCount);
+
+    vkCmdEndRenderPass(commandBuffer);
+}
+
+static void recordImageBarriers(VkCommandBuffer commandBuffer, const VkImageMemoryBarrier2* barriers, u32 barrierCount)
+{
+    VkDependencyInfo dependencyInfo = {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = barrierCount,
+        .pImageMemoryBarriers = barriers
+    };
+
+    g_vkCmdPipelineBarrier2(commandBuffer, &dependencyInfo);
+}
+
+// Does what the render pass from createRenderPass does, with the layout
+// transitions and subpass dependencies spelled out as barriers
+static void recordDynamicRenderingScene(VkCommandBuffer commandBuffer, const FrameRecordInfo* frameInfo, ParallelRecorder* recorder, u32 currentFrame)
+{
+    VkImageSubresourceRange colorSubresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount = 1,
+        .layerCount = 1
+    };
+
+    VkImageSubresourceRange depthSubresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT,
+        .levelCount = 1,
+        .layerCount = 1
+    };
+
+    VkImageMemoryBarrier2 beginBarriers[] = {
+        { // Chains onto the acquire semaphore wait at the color output stage
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .srcAccessMask = VK_ACCESS_2_NONE,
+            .dstStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+            .dstAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = frameInfo->colorImage,
+            .subresourceRange = colorSubresourceRange
+        },
+        { // The depth image is shared with the previous frame
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = frameInfo->depthImage,
+            .subresourceRange = depthSubresourceRange
+        }
+    };
+    recordImageBarriers(commandBuffer, beginBarriers, ARR_LEN(beginBarriers));
+
+    VkRenderingAttachmentInfo colorAttachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = frameInfo->colorImageView,
+        .imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_STORE,
+        .clearValue = {.color = {{0.f, 0.f, 0.f, 1.f}}}
+    };
+
+    VkRenderingAttachmentInfo depthAttachment = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO,
+        .imageView = frameInfo->depthImageView,
+        .imageLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        .loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+        .storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
+        .clearValue = {.depthStencil = {1.0f, 0}}
+    };
+
+    VkRenderingInfo renderingInfo = {
+        .sType = VK_STRUCTURE_TYPE_RENDERING_INFO,
+        .renderArea = {
+            .offset = {0, 0},
+            .extent = frameInfo->extent
+        },
+        .layerCount = 1,
+        .colorAttachmentCount = 1,
+        .pColorAttachments = &colorAttachment,
+        .pDepthAttachment = &depthAttachment
+    };
+
+    if (frameInfo->depthPrepassPipeline != VK_NULL_HANDLE)
+    {
+        VkRenderingAttachmentInfo prepassDepthAttachment = depthAttachment;
+        prepassDepthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+
+        VkRenderingInfo prepassRenderingInfo = renderingInfo;
+        prepassRenderingInfo.colorAttachmentCount = 0;
+        prepassRenderingInfo.pColorAttachments = NULL;
+        prepassRenderingInfo.pDepthAttachment = &prepassDepthAttachment;
+
+        beginGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_DEPTH_PREPASS);
+        g_vkCmdBeginRendering(commandBuffer, &prepassRenderingInfo);
+        recordDepthPrepassCommands(commandBuffer, frameInfo);
+        g_vkCmdEndRendering(commandBuffer);
+        endGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_DEPTH_PREPASS);
+
+        VkImageMemoryBarrier2 prepassBarrier = {
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .srcAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+            .dstStageMask = VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+            .dstAccessMask = VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT,
+            .oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = frameInfo->depthImage,
+            .subresourceRange = depthSubresourceRange
+        };
+        recordImageBarriers(commandBuffer, &prepassBarrier, 1);
+
+        depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+    }
+
+    if (recorder != NULL)
+        renderingInfo.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT;
+
+    beginGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_SCENE);
+    g_vkCmdBeginRendering(commandBuffer, &renderingInfo);
+    if (recorder != NULL)
+        vkCmdExecuteCommands(commandBuffer, recorder->threadCount, recorder->commandBuffers[currentFrame]);
+    else
+        recordDrawCommands(commandBuffer, frameInfo, g_drawCommands, g_drawCommandCount);
+    g_vkCmdEndRendering(commandBuffer);
+
+    // Presentation waits on the render finished semaphore, so only copies
+    // out of the image need to wait here
+    bool copiedOut = frameInfo->colorFinalLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    VkImageMemoryBarrier2 endBarrier = {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+        .srcStageMask = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT,
+        .srcAccessMask = VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT,
+        .dstStageMask = copiedOut ? VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT : VK_PIPELINE_STAGE_2_NONE,
+        .dstAccessMask = copiedOut ? VK_ACCESS_2_TRANSFER_READ_BIT : VK_ACCESS_2_NONE,
+        .oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        .newLayout = frameInfo->colorFinalLayout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image = frameInfo->colorImage,
+        .subresourceRange = colorSubresourceRange
+    };
+    recordImageBarriers(commandBuffer, &endBarrier, 1);
+}
+
+// Records the whole frame into commandBuffer. When a parallel recorder is
+// given, the draw list is split across its workers and the primary command
+// buffer only begins rendering and executes their secondaries. The depth
+// pre-pass is always recorded inline, in a subpass or rendering pass of its
+// own.
+static void recordFrameCommandBuffer(VkCommandBuffer commandBuffer, const FrameRecordInfo* frameInfo, ParallelRecorder* recorder, u32 currentFrame)
+{
+    VkCommandBufferBeginInfo commandBufferBeginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    if (vkBeginCommandBuffer(commandBuffer, &commandBufferBeginInfo) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to begin command buffer");
+
+    resetGpuQueries(frameInfo->gpuQueries, commandBuffer, currentFrame);
+    // Statistics cover the pre-pass as well, the scene pass is timed from
+    // the end of the pre-pass so the two passes never overlap
+    beginGpuPipelineStatistics(frameInfo->gpuQueries, commandBuffer, currentFrame);
+
+    if (recorder != NULL)
+    {
+        recorder->frameInfo = frameInfo;
+        recorder->currentFrame = currentFrame;
+        runWorkerTask(recorder->workerPool, recordSecondaryCommandBuffer, recorder);
+    }
+
+    if (frameInfo->renderPass != VK_NULL_HANDLE)
+        recordRenderPassScene(commandBuffer, frameInfo, recorder, currentFrame);
+    else
+        recordDynamicRenderingScene(commandBuffer, frameInfo, recorder, currentFrame);
+
+    endGpuPipelineStatistics(frameInfo->gpuQueries, commandBuffer, currentFrame);
+    endGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_SCENE);
+
+    if (frameInfo->upscaleTarget != VK_NULL_HANDLE)
+    {
+        beginGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_UPSCALE);
+        recordUpscaleBlit(commandBuffer, frameInfo);
+        endGpuPass(frameInfo->gpuQueries, commandBuffer, currentFrame, GPU_PASS_UPSCALE);
+    }
+
+    if (vkEndCommandBuffer(commandBuffer) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to end command buffer");
+}
+
+static bool isFrameRecordInfoEqual(const FrameRecordInfo* left, const FrameRecordInfo* right)
+{
+    return left->renderPass == right->renderPass
+        && left->framebuffer == right->framebuffer
+        && left->extent.width == right->extent.width
+        && left->extent.height == right->extent.height
+        && memcmp(&left->viewport, &right->viewport, sizeof(left->viewport)) == 0
+        && memcmp(&left->scissor, &right->scissor, sizeof(left->scissor)) == 0
+        && left->pipeline == right->pipeline
+        && left->pipelineLayout == right->pipelineLayout
+        && left->descriptorSet == right->descriptorSet
+        && left->vertexBuffer == right->vertexBuffer
+        && left->indexBuffer == right->indexBuffer
+        && left->gpuQueries == right->gpuQueries
+        && left->depthPrepassPipeline == right->depthPrepassPipeline
+        && left->positionBuffer == right->positionBuffer
+        && left->colorImage == right->colorImage
+        && left->colorImageView == right->colorImageView
+        && left->colorFormat == right->colorFormat
+        && left->colorFinalLayout == right->colorFinalLayout
+        && left->depthImage == right->depthImage
+        && left->depthImageView == right->depthImageView
+        && left->depthFormat == right->depthFormat
+        && left->upscaleSource == right->upscaleSource
+        && left->upscaleTarget == right->upscaleTarget
+        && left->upscaleTargetExtent.width == right->upscaleTargetExtent.width
+        && left->upscaleTargetExtent.height == right->upscaleTargetExtent.height;
+}
+
+// Command buffers recorded once per swapchain image and frame slot and then
+// resubmitted as long as the state they were recorded with stays the same.
+typedef struct
+{
+    VkCommandBuffer* commandBuffers;
+    FrameRecordInfo* recordedInfos;
+    bool* recorded;
+    u32 frameSlotCount;
+    u32 count;
+} PrerecordedCommandBuffers;
+
+static void allocatePrerecordedCommandBuffers(VkDevice device, VkCommandPool commandPool, u32 swapchainImageCount, u32 frameSlotCount, PrerecordedCommandBuffers* prerecorded)
+{
+    prerecorded->frameSlotCount = frameSlotCount;
+    prerecorded->count = swapchainImageCount * frameSlotCount;
+    prerecorded->commandBuffers = mallocOrDie(prerecorded->count * sizeof(VkCommandBuffer));
+    prerecorded->recordedInfos = mallocOrDie(prerecorded->count * sizeof(FrameRecordInfo));
+    prerecorded->recorded = mallocOrDie(prerecorded->count * sizeof(bool));
+
+    for (u32 i = 0; i < prerecorded->count; i++)
+        prerecorded->recorded[i] = false;
+
+    VkCommandBufferAllocateInfo allocateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = commandPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = prerecorded->count
+    };
+
+    if (vkAllocateCommandBuffers(device, &allocateInfo, prerecorded->commandBuffers) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to allocate prerecorded command buffers");
+}
+
+// The caller must make sure none of the command buffers are still pending
+static void freePrerecordedCommandBuffers(VkDevice device, VkCommandPool commandPool, PrerecordedCommandBuffers* prerecorded)
+{
+    if (prerecorded->count == 0)
+        return;
+
+    vkFreeCommandBuffers(device, commandPool, prerecorded->count, prerecorded->commandBuffers);
+    freeAndNull(prerecorded->commandBuffers);
+    freeAndNull(prerecorded->recordedInfos);
+    freeAndNull(prerecorded->recorded);
+    prerecorded->count = 0;
+}
+
+// Returns the command buffer for this image and frame slot, re-recording it
+// only if it was never recorded or the frame state has changed since. Its
+// previous submission used the same frame slot, which has already been
+// waited on.
+static VkCommandBuffer getPrerecordedCommandBuffer(PrerecordedCommandBuffers* prerecorded, const FrameRecordInfo* frameInfo, u32 imageIndex, u32 currentFrame)
+{
+    u32 index = imageIndex * prerecorded->frameSlotCount + currentFrame;
+    ASSERT(index < prerecorded->count);
+
+    if (!prerecorded->recorded[index] || !isFrameRecordInfoEqual(&prerecorded->recordedInfos[index], frameInfo))
+    {
+        recordFrameCommandBuffer(prerecorded->commandBuffers[index], frameInfo, NULL, currentFrame);
+        prerecorded->recordedInfos[index] = *frameInfo;
+        prerecorded->recorded[index] = true;
+    }
+
+    return prerecorded->commandBuffers[index];
+}
+
+#define MAX_RETIRED_SWAPCHAINS 8
+
+// A swapchain replaced on resize, kept alive until every frame that may
+// still reference its framebuffers has completed. The depth attachment and
+// the dynamic resolution target are only retired along with it when the
+// size changed, otherwise the new swapchain reuses them.
+typedef struct
+{
+    VkSwapchainKHR swapchain;
+    u32 imageCount;
+    VkImageView* imageViews;
+    VkFramebuffer* framebuffers;
+    VkImage depthImage;
+    VkImageView depthImageView;
+    GpuAllocation depthImageAllocation;
+    OffscreenTarget offscreenTarget;
+    PrerecordedCommandBuffers prerecorded;
+    // Timeline value of the last submission that may have used it
+    u64 timelineValue;
+} RetiredSwapchain;
+
+static void destroyRetiredSwapchain(GpuAllocator* allocator, VkDevice device, VkCommandPool commandPool, RetiredSwapchain* retired)
+{
+    destroySwapchain(device, &retired->swapchain, retired->imageCount, NULL, retired->imageViews, retired->framebuffers);
+    freePrerecordedCommandBuffers(device, commandPool, &retired->prerecorded);
+
+    if (retired->offscreenTarget.slotCount > 0)
+        destroyOffscreenTarget(allocator, device, commandPool, &retired->offscreenTarget);
+
+    if (retired->depthImage != VK_NULL_HANDLE)
+    {
+        vkDestroyImageView(device, retired->depthImageView, NULL);
+        vkDestroyImage(device, retired->depthImage, NULL);
+        freeGpuMemory(allocator, &retired->depthImageAllocation);
+    }
+}
+
+// Destroys the swapchains no submission in flight uses anymore and returns
+// how many remain
+static u32 releaseRetiredSwapchains(GpuAllocator* allocator, VkDevice device, VkCommandPool commandPool, GpuTimeline* timeline, RetiredSwapchain* retired, u32 retiredCount)
+{
+    u32 remainingCount = 0;
+    for (u32 i = 0; i < retiredCount; i++)
+    {
+        if (isGpuTimelineValueComplete(timeline, retired[i].timelineValue))
+            destroyRetiredSwapchain(allocator, device, commandPool, &retired[i]);
+        else
+            retired[remainingCount++] = retired[i];
+    }
+
+    return remainingCount;
+}
+
+typedef struct
+{
+    int width;
+    int height;
+    bool resized;
+} WindowFramebufferInfo;
+
+static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
+{
+    WindowFramebufferInfo* framebufferInfo = glfwGetWindowUserPointer(window);
+    framebufferInfo->width = width;
+    framebufferInfo->height = height;
+    framebufferInfo->resized = true;
+}
+
+static void windowRefreshCallback(GLFWwindow* window)
+{
+    (void)window;
+    g_redrawRequested = true;
+}
+
+static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+    if (action != GLFW_PRESS)
+        return;
+
+    g_redrawRequested = true;
+
+    switch (key)
+    {
+        case GLFW_KEY_ESCAPE:
+            glfwSetWindowShouldClose(window, 1);
+            break;
+        case GLFW_KEY_T:
+            g_showTexture = !g_showTexture;
+            break;
+        case GLFW_KEY_SPACE:
+            g_rotationPaused = !g_rotationPaused;
+            break;
+        case GLFW_KEY_V:
+            g_debugView = (g_debugView + 1) % DEBUG_VIEW_COUNT;
+            break;
+        case GLFW_KEY_P:
+            g_profilerDumpRequested = true;
+            break;
+        case GLFW_KEY_R:
+            g_reloadRequested = true;
+            break;
+        case GLFW_KEY_A:
+            g_modelX += 1.0f;
+            break;
+        case GLFW_KEY_D:
+            g_modelX -= 1.0f;
+            break;
+        case GLFW_KEY_Q:
+            g_modelY += 1.0f;
+            break;
+        case GLFW_KEY_E:
+            g_modelY -= 1.0f;
+            break;
+        case GLFW_KEY_W:
+            g_modelZ += 1.0f;
+            break;
+        case GLFW_KEY_S:
+            g_modelZ -= 1.0f;
+            break;
+    }
+}
+
+// Shows the average of the recent GPU timings in the window title, and on
+// the console when requested. Debug views also get the average number of
+// fragments shaded per pixel of the render area.
+static void showGpuTimingReadout(const GpuQueries* gpuQueries, const GpuFrameTimings* history, u32 historyCount, DebugView debugView, u64 renderPixelCount,
+    const GpuAllocator* gpuAllocator, GLFWwindow* window, bool console)
+{
+    GpuFrameTimings average = {0};
+    char readout[256] = "";
+    if (historyCount > 0)
+    {
+        averageGpuFrameTimings(history, (historyCount < GPU_TIMING_HISTORY_SIZE) ? historyCount : GPU_TIMING_HISTORY_SIZE, &average);
+        formatGpuFrameTimings(gpuQueries, &average, readout, sizeof(readout));
+    }
+
+    char memoryUsage[64];
+    formatGpuMemoryUsage(gpuAllocator, memoryUsage, sizeof(memoryUsage));
+    if (memoryUsage[0] != '\0')
+    {
+        usize length = strlen(readout);
+        snprintf(readout + length, sizeof(readout) - length, "%s%s", (length > 0) ? " | " : "", memoryUsage);
+    }
+
+    if (readout[0] == '\0')
+        return;
+
+    if (debugView != DEBUG_VIEW_NONE)
+    {
+        usize length = strlen(readout);
+        // Only the overdraw view shades one fragment per covered sample of
+        // every triangle, the others shade points or lines
+        if (average.hasStatistics && renderPixelCount > 0)
+        {
+            snprintf(readout + length, sizeof(readout) - length,
+                (debugView == DEBUG_VIEW_OVERDRAW) ? " | %s | overdraw %.2fx" : " | %s | fs per pixel %.2f", debugViewNames[debugView],
+                (f64)average.statistics.fragmentShaderInvocations / renderPixelCount);
+        }
+        else
+        {
+            snprintf(readout + length, sizeof(readout) - length, " | %s", debugViewNames[debugView]);
+        }
+    }
+
+    if (window != NULL)
+    {
+        char title[sizeof(readout) + sizeof(WINDOW_TITLE) + 8];
+        snprintf(title, sizeof(title), "%s | %s", WINDOW_TITLE, readout);
+        glfwSetWindowTitle(window, title);
+    }
+
+    if (console)
+        fprintf(stderr, "%s\n", readout);
+}
+
+typedef struct
+{
+    const char* objFilePath;
+    const char* textureFilePath;
+    const char* dumpDirectory;
+    const char* profilePath;
+    u32 recordThreadCount;
+    u32 frameCount;
+    u32 benchFrameCount;
+    u32 framesInFlight;
+    VkPresentModeKHR presentMode;
+    f64 frameBudgetMilliseconds;
+    bool prerecord;
+    bool headless;
+    bool gpuTimings;
+    bool lowLatency;
+    bool onDemand;
+    bool depthPrepass;
+    bool disableCulling;
+    bool dynamicRendering;
+    bool memoryReport;
+} Options;
+
+#define USAGE "usage: scop [--record-threads count] [--prerecord] [--texture ktx2_or_dds_file] [--headless] [--frames count] [--dump-frames directory] [--bench count] [--gpu-timings] [--profile trace_file] [--present-mode fifo|fifo_relaxed|mailbox|immediate] [--frames-in-flight count] [--low-latency] [--on-demand] [--frame-budget milliseconds] [--depth-prepass] [--no-culling] [--dynamic-rendering] [--memory-report] obj_file"
+
+static u32 parseCountArgument(const char* option, const char* value, u32 minCount, u32 maxCount)
+{
+    char* end;
+    long count = strtol(value, &end, 10);
+    if (value[0] == '\0' || *end != '\0' || count < (long)minCount || count > (long)maxCount)
+        PANIC("%s%s%s%u%s%u\n", "Invalid value for ", option, ", expected ", minCount, " to ", maxCount);
+
+    return (u32)count;
+}
+
+static f64 parseMillisecondsArgument(const char* option, const char* value)
+{
+    char* end;
+    f64 milliseconds = strtod(value, &end);
+    if (value[0] == '\0' || *end != '\0' || !(milliseconds > 0.0))
+        PANIC("%s%s%s\n", "Invalid value for ", option, ", expected a positive number of milliseconds");
+
+    return milliseconds;
+}
+
+static VkPresentModeKHR parsePresentModeArgument(const char* value)
+{
+    for (u32 i = 0; i < ARR_LEN(presentModeNames); i++)
+        if (strcmp(value, presentModeNames[i].name) == 0)
+            return presentModeNames[i].mode;
+
+    PANIC("%s%s\n", "Unknown present mode: ", value);
+}
+
+static Options parseOptions(int argc, char* argv[])
+{
+    Options options = {
+        .framesInFlight = DEFAULT_FRAMES_IN_FLIGHT,
+        .presentMode = VK_PRESENT_MODE_MAILBOX_KHR
+    };
+
+    for (int i = 1; i < argc; i++)
+    {
+        bool hasValue = i + 1 < argc;
+        if (strcmp(argv[i], "--record-threads") == 0 && hasValue)
+        {
+            options.recordThreadCount = parseCountArgument(argv[i], argv[i + 1], 0, MAX_RECORD_THREADS);
+            i++;
+        }
+        else if (strcmp(argv[i], "--prerecord") == 0)
+        {
+            options.prerecord = true;
+        }
+        else if (strcmp(argv[i], "--texture") == 0 && hasValue)
+        {
+            options.textureFilePath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--headless") == 0)
+        {
+            options.headless = true;
+        }
+        else if (strcmp(argv[i], "--frames") == 0 && hasValue)
+        {
+            options.frameCount = parseCountArgument(argv[i], argv[i + 1], 1, UINT32_MAX >> 1);
+            i++;
+        }
+        else if (strcmp(argv[i], "--dump-frames") == 0 && hasValue)
+        {
+            options.dumpDirectory = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--profile") == 0 && hasValue)
+        {
+            options.profilePath = argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "--gpu-timings") == 0)
+        {
+            options.gpuTimings = true;
+        }
+        else if (strcmp(argv[i], "--bench") == 0 && hasValue)
+        {
+            options.benchFrameCount = parseCountArgument(argv[i], argv[i + 1], 1, UINT32_MAX >> 1);
+            i++;
+        }
+        else if (strcmp(argv[i], "--present-mode") == 0 && hasValue)
+        {
+            options.presentMode = parsePresentModeArgument(argv[i + 1]);
+            i++;
+        }
+        else if (strcmp(argv[i], "--frames-in-flight") == 0 && hasValue)
+        {
+            options.framesInFlight = parseCountArgument(argv[i], argv[i + 1], 1, MAX_FRAMES_IN_FLIGHT);
+            i++;
+        }
+        else if (strcmp(argv[i], "--low-latency") == 0)
+        {
+            options.lowLatency = true;
+        }
+        else if (strcmp(argv[i], "--on-demand") == 0)
+        {
+            options.onDemand = true;
+        }
+        else if (strcmp(argv[i], "--depth-prepass") == 0)
+        {
+            options.depthPrepass = true;
+        }
+        else if (strcmp(argv[i], "--no-culling") == 0)
+        {
+            options.disableCulling = true;
+        }
+        else if (strcmp(argv[i], "--dynamic-rendering") == 0)
+        {
+            options.dynamicRendering = true;
+        }
+        else if (strcmp(argv[i], "--memory-report") == 0)
+        {
+            options.memoryReport = true;
+        }
+        else if (strcmp(argv[i], "--frame-budget") == 0 && hasValue)
+        {
+            options.frameBudgetMilliseconds = parseMillisecondsArgument(argv[i], argv[i + 1]);
+            i++;
+        }
+        else if (argv[i][0] == '-' || options.objFilePath != NULL)
+        {
+            PANIC("%s\n", USAGE);
+        }
+        else
+        {
+            options.objFilePath = argv[i];
+        }
     }
-}
 
-void updateUniformBuffer(void* uniformBuffersMapped[], VkExtent2D surfaceExtent, u32 currentImage)
-{
-    float time = (float)clock() / CLOCKS_PER_SEC;
-    if (time == -1)
-        PANIC("%s\n", "Failed to read system clock");
+    if (options.objFilePath == NULL)
+        PANIC("%s\n", USAGE);
 
-    UniformBufferObject ubo = {
-        .model = mulMat4(translate((Vec3){g_modelX, g_modelY, g_modelZ}), rotateRH(time, (Vec3){0.0f, 1.0f, 0.0f})),
-        .view = LookAtRH((Vec3){0.0f, 0.0f, 2.0f}, (Vec3){0.0f, 0.0f, 0.0f}, (Vec3){0.0f, 1.0f, 0.0f}),
-        .proj = perspectiveRH(45.0f, surfaceExtent.width / (f32)surfaceExtent.height, 0.1f, 100.0f),
-        .colorToTextureRatio = g_colorToTextureRatio
-    };
+    // Swapchain images cannot be read back, frames are only dumped from the
+    // offscreen target
+    if (options.dumpDirectory != NULL && !options.headless)
+        PANIC("%s\n", "--dump-frames requires --headless");
 
-    ubo.proj.elements[1][1] *= -1;
+    // Headless frames are rendered at a fixed size so dumps stay comparable
+    if (options.frameBudgetMilliseconds > 0.0 && options.headless)
+        PANIC("%s\n", "--frame-budget cannot be combined with --headless");
 
-    memcpy(uniformBuffersMapped[currentImage], &ubo, sizeof(ubo));
-}
+    // Frames are only rendered in response to window events
+    if (options.onDemand && (options.headless || options.benchFrameCount > 0))
+        PANIC("%s\n", "--on-demand cannot be combined with --headless or --bench");
 
-typedef struct
-{
-    int width;
-    int height;
-    bool resized;
-} WindowFramebufferInfo;
+    // Benchmarks end on their own once all measured frames are in
+    if (options.benchFrameCount > 0 && options.frameCount > 0)
+        PANIC("%s\n", "--frames cannot be combined with --bench");
 
-static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
-{
-    WindowFramebufferInfo* framebufferInfo = glfwGetWindowUserPointer(window);
-    framebufferInfo->width = width;
-    framebufferInfo->height = height;
-    framebufferInfo->resized = true;
-}
+    // Without a window there is nothing to close, so headless runs stop
+    // after a fixed number of frames
+    if (options.headless && options.frameCount == 0 && options.benchFrameCount == 0)
+        options.frameCount = 1;
 
-static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
-{
-    if (action != GLFW_PRESS)
-        return;
-    
-    switch (key)
+    // Prerecorded command buffers outlive a single frame, which the
+    // per-frame secondaries of the recording threads do not
+    if (options.prerecord && options.recordThreadCount > 0)
     {
-        case GLFW_KEY_ESCAPE:
-            glfwSetWindowShouldClose(window, 1);
-            break;
-        case GLFW_KEY_T:
-            g_showTexture = !g_showTexture;
-            break;
-        case GLFW_KEY_A:
-            g_modelX += 1.0f;
-            break;
-        case GLFW_KEY_D:
-            g_modelX -= 1.0f;
-            break;
-        case GLFW_KEY_Q:
-            g_modelY += 1.0f;
-            break;
-        case GLFW_KEY_E:
-            g_modelY -= 1.0f;
-            break;
-        case GLFW_KEY_W:
-            g_modelZ += 1.0f;
-            break;
-        case GLFW_KEY_S:
-            g_modelZ -= 1.0f;
-            break;
+        INFORM("%s\n", "--prerecord records on the main thread, ignoring --record-threads");
+        options.recordThreadCount = 0;
     }
+
+    return options;
 }
 
+// Also runs after a PANIC, so the trace covers what led up to it
 static void onExit(void)
 {
+    if (g_profilerTracePath != NULL)
+        writeProfilerTrace(g_profilerTracePath);
+    shutdownProfiler();
+
     glfwTerminate();
 
-    freeAndNull(g_vertices);
-    freeAndNull(g_indices);
+    freeModel(&g_model);
+    freeAndNull(g_drawCommands);
 }
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
-        PANIC("%s\n", "usage: scop obj_file");
+    Options options = parseOptions(argc, argv);
+
+    initProfiler(options.profilePath != NULL);
+    setProfilerThreadName("main");
+    g_profilerTracePath = options.profilePath;
 
     if (atexit(onExit) != 0)
         PANIC("%s\n", "Failed to register atexit function");
 
-    if (!glfwInit())
-        PANIC("%s\n", "Failed to initialize GLFW");
-
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
-    GLFWwindow* window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
-    if (window == NULL)
-        PANIC("%s\n", "Failed to create GLFW window");
-
     WindowFramebufferInfo windowFramebufferInfo = {
         .width = WINDOW_WIDTH,
         .height = WINDOW_HEIGHT,
         .resized = false
     };
 
-    glfwSetWindowUserPointer(window, &windowFramebufferInfo);
-    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
-    glfwSetKeyCallback(window, keyCallback);
+    // Headless runs never touch GLFW, which needs a display to initialize
+    GLFWwindow* window = NULL;
+    if (!options.headless)
+    {
+        if (!glfwInit())
+            PANIC("%s\n", "Failed to initialize GLFW");
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
+        window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, WINDOW_TITLE, NULL, NULL);
+        if (window == NULL)
+            PANIC("%s\n", "Failed to create GLFW window");
+
+        glfwSetWindowUserPointer(window, &windowFramebufferInfo);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+
+        // Benchmarks keep the model and camera on their fixed path
+        if (options.benchFrameCount == 0)
+            glfwSetKeyCallback(window, keyCallback);
+    }
 
-    parseObjFile(argv[1], &g_vertices, &g_vertexCount, &g_indices, &g_indexCount);
-    normalizeAndCenterModel();
+    ProfileZone zone = beginProfileZone("parse obj");
+    loadModel(options.objFilePath, &g_model);
+    buildDrawCommands();
+    endProfileZone(zone);
+
+    Texture texture;
+    if (options.textureFilePath != NULL)
+    {
+        zone = beginProfileZone("load texture");
+        loadTextureFile(options.textureFilePath, &texture);
+        endProfileZone(zone);
+    }
+    else
+    {
+        usize textureDataSize = (usize)g_textureDataWidth * g_textureDataHeight * 4;
+        u8* pixels = mallocOrDie(textureDataSize);
+        memcpy(pixels, g_textureData, textureDataSize);
+        createRGBA8Texture(pixels, g_textureDataWidth, g_textureDataHeight, true, &texture);
+    }
 
-    VkInstance instance = createVulkanInstance();
+    u32 instanceApiVersion;
+    VkInstance instance = createVulkanInstance(options.headless, &instanceApiVersion);
 
-    VkSurfaceKHR surface;
-    if (glfwCreateWindowSurface(instance, window, NULL, &surface) != VK_SUCCESS)
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    if (!options.headless && glfwCreateWindowSurface(instance, window, NULL, &surface) != VK_SUCCESS)
         PANIC("%s\n", "Failed to create window surface");
 
     u32 queueFamilyIndex;
-    VkPhysicalDevice physicalDevice = pickPhysicalDeviceAndQueueFamily(instance, surface, &queueFamilyIndex);
+    u32 transferQueueFamilyIndex;
+    VkPhysicalDevice physicalDevice = pickPhysicalDeviceAndQueueFamily(instance, instanceApiVersion, surface, &queueFamilyIndex, &transferQueueFamilyIndex);
 
     float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-        .queueFamilyIndex = queueFamilyIndex,
-        .queueCount = 1,
-        .pQueuePriorities = &queuePriority
+    VkDeviceQueueCreateInfo queueCreateInfos[] = {
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = queueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriority
+        },
+        {
+            .sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+            .queueFamilyIndex = transferQueueFamilyIndex,
+            .queueCount = 1,
+            .pQueuePriorities = &queuePriority
+        }
     };
 
-    VkPhysicalDeviceFeatures physicalDeviceFeatures = {.samplerAnisotropy = VK_TRUE};
+    VkPhysicalDeviceFeatures supportedFeatures;
+    vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+    // Block compressed formats are only sampleable with their feature enabled.
+    // Anisotropy is optional since software implementations may lack it.
+    VkPhysicalDeviceFeatures physicalDeviceFeatures = {
+        .samplerAnisotropy = supportedFeatures.samplerAnisotropy,
+        .fillModeNonSolid = supportedFeatures.fillModeNonSolid,
+        .textureCompressionBC = supportedFeatures.textureCompressionBC,
+        .textureCompressionETC2 = supportedFeatures.textureCompressionETC2,
+        .pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery,
+        .inheritedQueries = supportedFeatures.inheritedQueries && options.recordThreadCount > 0
+    };
+
+    // Without Vulkan 1.3 the render pass path is used instead
+    bool dynamicRendering = options.dynamicRendering && isDynamicRenderingSupported(physicalDevice, instanceApiVersion);
+    if (options.dynamicRendering && !dynamicRendering)
+        INFORM("%s\n", "Dynamic rendering is not supported, falling back to render passes");
+
+    VkPhysicalDeviceVulkan13Features vulkan13Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+        .synchronization2 = VK_TRUE,
+        .dynamicRendering = VK_TRUE
+    };
+
+    VkPhysicalDeviceVulkan12Features vulkan12Features = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .pNext = dynamicRendering ? &vulkan13Features : NULL,
+        .timelineSemaphore = VK_TRUE
+    };
+
+    // Without the budget extension the allocator estimates budgets from the
+    // heap sizes
+    const char* enabledDeviceExtensionNames[ARR_LEN(deviceExtensionNames) + 1];
+    u32 enabledDeviceExtensionCount = getDeviceExtensionCount(options.headless);
+    memcpy(enabledDeviceExtensionNames, deviceExtensionNames, enabledDeviceExtensionCount * sizeof(char*));
+
+    bool memoryBudgetEnabled = isDeviceExtensionSupported(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+    if (memoryBudgetEnabled)
+        enabledDeviceExtensionNames[enabledDeviceExtensionCount++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
 
     VkDeviceCreateInfo deviceCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .queueCreateInfoCount = 1,
-        .pQueueCreateInfos = &queueCreateInfo,
+        .pNext = &vulkan12Features,
+        .queueCreateInfoCount = (transferQueueFamilyIndex != queueFamilyIndex) ? 2 : 1,
+        .pQueueCreateInfos = queueCreateInfos,
         .enabledLayerCount = validationLayerCount,
         .ppEnabledLayerNames = validationLayerNames,
-        .enabledExtensionCount = deviceExtensionCount,
-        .ppEnabledExtensionNames = deviceExtensionNames,
+        .enabledExtensionCount = enabledDeviceExtensionCount,
+        .ppEnabledExtensionNames = enabledDeviceExtensionNames,
         .pEnabledFeatures = &physicalDeviceFeatures
     };
 
@@ -1158,14 +3364,73 @@ int main(int argc, char* argv[])
     VkQueue queue;
     vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
 
-    VkSurfaceCapabilitiesKHR surfaceCapabilities;
-    if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities) != VK_SUCCESS)
-        PANIC("%s\n", "Failed to determine physical device surface capabilities");
+    VkQueue transferQueue;
+    vkGetDeviceQueue(device, transferQueueFamilyIndex, 0, &transferQueue);
+
+    if (dynamicRendering)
+        loadDynamicRenderingFunctions(device);
+
+    GpuTimeline timeline;
+    createGpuTimeline(device, &timeline);
+
+    GpuAllocator* gpuAllocator = createGpuAllocator(physicalDevice, device, memoryBudgetEnabled);
+    // Secondaries from the recording threads can only run inside the
+    // statistics query with inherited queries
+    bool pipelineStatisticsEnabled = physicalDeviceFeatures.pipelineStatisticsQuery && (options.recordThreadCount == 0 || physicalDeviceFeatures.inheritedQueries);
+    GpuQueries* gpuQueries = createGpuQueries(physicalDevice, device, queueFamilyIndex, pipelineStatisticsEnabled,
+        options.framesInFlight, GPU_PASS_COUNT, gpuPassNames);
+
+    if (transferQueueFamilyIndex != queueFamilyIndex)
+        INFORM("%s%u\n", "Using dedicated transfer queue family ", transferQueueFamilyIndex);
+
+    VkSurfaceCapabilitiesKHR surfaceCapabilities = {0};
+    VkSurfaceFormatKHR surfaceFormat = {.format = OFFSCREEN_COLOR_FORMAT};
+    VkPresentModeKHR surfacePresentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (!options.headless)
+    {
+        if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities) != VK_SUCCESS)
+            PANIC("%s\n", "Failed to determine physical device surface capabilities");
+
+        surfaceFormat = pickSurfaceFormat(physicalDevice, surface);
+        surfacePresentMode = pickSurfacePresentMode(physicalDevice, surface, options.presentMode);
+    }
+
+    // Dynamic resolution renders into an offscreen target and blits it
+    // onto the swapchain images, which have to accept transfer writes
+    bool dynamicResolution = false;
+    ResolutionScaler resolutionScaler;
+    if (options.frameBudgetMilliseconds > 0.0)
+    {
+        VkFormatProperties surfaceFormatProperties;
+        vkGetPhysicalDeviceFormatProperties(physicalDevice, surfaceFormat.format, &surfaceFormatProperties);
+
+        dynamicResolution = isLinearBlitSupported(physicalDevice, OFFSCREEN_COLOR_FORMAT)
+            && (surfaceFormatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT)
+            && (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT);
+
+        if (dynamicResolution)
+            createResolutionScaler(&resolutionScaler, options.frameBudgetMilliseconds, MIN_RENDER_SCALE, 1.0f);
+        else
+            INFORM("%s\n", "Swapchain cannot be blitted to, ignoring --frame-budget");
+    }
+
+    bool offscreenColor = options.headless || dynamicResolution;
+    VkImageLayout colorFinalLayout = offscreenColor ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    VkFormat colorFormat = offscreenColor ? OFFSCREEN_COLOR_FORMAT : surfaceFormat.format;
+    VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
 
-    VkSurfaceFormatKHR surfaceFormat = pickSurfaceFormat(physicalDevice, surface);
-    VkPresentModeKHR surfacePresentMode = pickSurfacePresentMode(physicalDevice, surface);
+    // Dynamic rendering has no render pass, pipelines only name the formats
+    // of the attachments they are used with
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+    if (!dynamicRendering)
+        renderPass = createRenderPass(device, colorFormat, colorFinalLayout, options.depthPrepass);
 
-    VkRenderPass renderPass = createRenderPass(device, surfaceFormat.format);
+    VkPipelineRenderingCreateInfo pipelineRenderingCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO,
+        .colorAttachmentCount = 1,
+        .pColorAttachmentFormats = &colorFormat,
+        .depthAttachmentFormat = depthFormat
+    };
 
     VkDescriptorSetLayoutBinding descriptorSetLayoutBindingUBO = {
         .binding = 0,
@@ -1196,8 +3461,19 @@ int main(int argc, char* argv[])
     if (vkCreateDescriptorSetLayout(device, &descriptorSetLayoutCreateInfo, NULL, &descriptorSetLayout) != VK_SUCCESS)
         PANIC("%s\n", "Failed to create descriptor set layout");
 
+    VkPipelineCache pipelineCache = loadPipelineCache(physicalDevice, device);
+
     VkPipelineLayout pipelineLayout;
-    VkPipeline graphicsPipeline = createGraphicsPipeline(device, renderPass, descriptorSetLayout, &pipelineLayout);
+    VkPipeline graphicsPipelines[CULL_VARIANT_COUNT][SHADING_MODE_COUNT];
+    createGraphicsPipelines(device, pipelineCache, renderPass, dynamicRendering ? &pipelineRenderingCreateInfo : NULL, descriptorSetLayout,
+        physicalDeviceFeatures.fillModeNonSolid, options.depthPrepass, &pipelineLayout, graphicsPipelines);
+
+    VkPipeline depthPrepassPipelines[CULL_VARIANT_COUNT] = {VK_NULL_HANDLE};
+    if (options.depthPrepass)
+    {
+        for (u32 i = 0; i < CULL_VARIANT_COUNT; i++)
+            depthPrepassPipelines[i] = createDepthPrepassPipeline(device, pipelineCache, renderPass, dynamicRendering ? &pipelineRenderingCreateInfo : NULL, pipelineLayout, i);
+    }
 
     VkCommandPoolCreateInfo commandPoolCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -1213,43 +3489,88 @@ int main(int argc, char* argv[])
         .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
         .commandPool = commandPool,
         .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
-        .commandBufferCount = MAX_FRAMES_IN_FLIGHT
+        .commandBufferCount = options.framesInFlight
     };
 
     VkCommandBuffer commandBuffers[MAX_FRAMES_IN_FLIGHT];
     if (vkAllocateCommandBuffers(device, &commandBufferAllocateInfo, commandBuffers) != VK_SUCCESS)
         PANIC("%s\n", "Failed to allocate command buffers");
 
-    VkDeviceMemory textureImageMemory;
-    VkImage textureImage = createTextureImage(physicalDevice, device, queue, commandPool, &textureImageMemory);
-    VkImageView textureImageView = createImageView(device, textureImage, VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_ASPECT_COLOR_BIT);
-    VkSampler textureSampler = createTextureSampler(physicalDevice, device);
+    ParallelRecorder parallelRecorder;
+    if (options.recordThreadCount > 0)
+        createParallelRecorder(&parallelRecorder, device, queueFamilyIndex, options.recordThreadCount, options.framesInFlight);
+
+    VkCommandPoolCreateInfo transferCommandPoolCreateInfo = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+        .queueFamilyIndex = transferQueueFamilyIndex
+    };
 
-    VkDeviceMemory vertexBufferMemory;
-    VkBuffer vertexBuffer = createVertexBuffer(physicalDevice, device, queue, commandPool, &vertexBufferMemory);
+    VkCommandPool transferCommandPool;
+    if (vkCreateCommandPool(device, &transferCommandPoolCreateInfo, NULL, &transferCommandPool) != VK_SUCCESS)
+        PANIC("%s\n", "Failed to create transfer command pool");
+
+    UploadQueues uploadQueues = {
+        .transferQueue = transferQueue,
+        .transferCommandPool = transferCommandPool,
+        .transferQueueFamilyIndex = transferQueueFamilyIndex,
+        .graphicsQueue = queue,
+        .graphicsCommandPool = commandPool,
+        .graphicsQueueFamilyIndex = queueFamilyIndex,
+        .timeline = &timeline
+    };
 
-    VkDeviceMemory indexBufferMemory;
-    VkBuffer indexBuffer = createIndexBuffer(physicalDevice, device, queue, commandPool, &indexBufferMemory);
+    UploadBatch uploadBatch;
+    beginUploadBatch(device, gpuAllocator, &uploadQueues, &uploadBatch);
+
+    // The mesh goes first since only the texture can be shrunk to fit
+    VkDeviceSize meshBuffersSize = getMeshBuffersSize(&g_model, options.depthPrepass);
+    if (!fitsGpuMemoryBudget(gpuAllocator, meshBuffersSize, meshBuffersSize))
+        PANIC("%s\n", "Model does not fit in the GPU memory budget");
+
+    MeshBuffers mesh;
+    createMeshBuffers(device, &uploadBatch, &g_model, options.depthPrepass, &mesh);
+
+    GpuAllocation textureImageAllocation;
+    VkFormat textureFormat;
+    u32 textureMipLevels;
+    VkImage textureImage = createTextureImage(physicalDevice, device, &uploadBatch, &texture, &textureImageAllocation, &textureFormat, &textureMipLevels);
+    VkImageView textureImageView = createImageView(device, textureImage, textureFormat, VK_IMAGE_ASPECT_COLOR_BIT, textureMipLevels);
+    freeTexture(&texture);
+    VkSampler textureSampler = createTextureSampler(physicalDevice, device, physicalDeviceFeatures.samplerAnisotropy);
+
+    submitUploadBatch(&uploadBatch);
+    logGpuAllocatorStats(gpuAllocator);
+
+    // Reloads upload on the transfer queue while the current mesh keeps
+    // rendering, the old buffers are retired once no frame in flight uses them
+    UploadBatch reloadBatch = {0};
+    // A reloaded model only replaces g_model once its mesh is live
+    Model pendingModel = {0};
+    MeshBuffers pendingMesh = {0};
+    MeshBuffers retiredMesh = {0};
+    u64 retiredMeshTimelineValue = 0;
+    u64 frameNumber = 0;
 
     VkBuffer uniformBuffers[MAX_FRAMES_IN_FLIGHT];
-    VkDeviceMemory uniformBuffersMemory[MAX_FRAMES_IN_FLIGHT];
+    GpuAllocation uniformBuffersAllocations[MAX_FRAMES_IN_FLIGHT];
     void* uniformBuffersMapped[MAX_FRAMES_IN_FLIGHT];
-    createUniformBuffers(physicalDevice, device, uniformBuffers, uniformBuffersMemory, uniformBuffersMapped);
+    createUniformBuffers(gpuAllocator, device, options.framesInFlight, uniformBuffers, uniformBuffersAllocations, uniformBuffersMapped);
 
     VkDescriptorPoolSize descriptorPoolSizes[] = {
         {
             .type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-            .descriptorCount = MAX_FRAMES_IN_FLIGHT
+            .descriptorCount = options.framesInFlight
         },
         {
             .type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-            .descriptorCount = MAX_FRAMES_IN_FLIGHT
+            .descriptorCount = options.framesInFlight
         }
     };
 
     VkDescriptorPoolCreateInfo descriptorPoolCreateInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = MAX_FRAMES_IN_FLIGHT,
+        .maxSets = options.framesInFlight,
         .poolSizeCount = ARR_LEN(descriptorPoolSizes),
         .pPoolSizes = descriptorPoolSizes
     };
@@ -1259,13 +3580,13 @@ int main(int argc, char* argv[])
         PANIC("%s\n", "Failed to create descriptor pool");
 
     VkDescriptorSetLayout descriptorSetLayouts[MAX_FRAMES_IN_FLIGHT];
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    for (u32 i = 0; i < options.framesInFlight; i++)
         descriptorSetLayouts[i] = descriptorSetLayout;
 
     VkDescriptorSetAllocateInfo descriptorSetAllocateInfo = {
         .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
         .descriptorPool = descriptorPool,
-        .descriptorSetCount = MAX_FRAMES_IN_FLIGHT,
+        .descriptorSetCount = options.framesInFlight,
         .pSetLayouts = descriptorSetLayouts
     };
 
@@ -1273,7 +3594,7 @@ int main(int argc, char* argv[])
     if (vkAllocateDescriptorSets(device, &descriptorSetAllocateInfo, descriptorSets) != VK_SUCCESS)
         PANIC("%s\n", "Failed to allocate descriptor sets");
 
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    for (u32 i = 0; i < options.framesInFlight; i++)
     {
         VkDescriptorBufferInfo descriptorBufferInfo = {
             .buffer = uniformBuffers[i],
@@ -1313,23 +3634,17 @@ int main(int argc, char* argv[])
 
     VkSemaphoreCreateInfo semaphoreCreateInfo = {.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
 
-    VkFenceCreateInfo fenceCreateInfo = {
-        .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-        .flags = VK_FENCE_CREATE_SIGNALED_BIT
-    };
-
+    // Presentation only works with binary semaphores, everything else waits
+    // on the timeline value each frame slot last signaled
     VkSemaphore imageAvailableSemaphores[MAX_FRAMES_IN_FLIGHT];
     VkSemaphore renderFinishedSemaphores[MAX_FRAMES_IN_FLIGHT];
-    VkFence inFlightFences[MAX_FRAMES_IN_FLIGHT];
+    u64 frameTimelineValues[MAX_FRAMES_IN_FLIGHT] = {0};
 
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    for (u32 i = 0; i < options.framesInFlight; i++)
     {
         if (vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
             vkCreateSemaphore(device, &semaphoreCreateInfo, NULL, &renderFinishedSemaphores[i]) != VK_SUCCESS)
             PANIC("%s\n", "Failed to create semaphore");
-
-        if (vkCreateFence(device, &fenceCreateInfo, NULL, &inFlightFences[i]) != VK_SUCCESS)
-            PANIC("%s\n", "Failed to create fence");
     }
 
     VkExtent2D surfaceExtent;
@@ -1340,16 +3655,156 @@ int main(int argc, char* argv[])
     VkImage* swapchainImages = NULL;
     VkImageView* swapchainImageViews = NULL;
     VkFramebuffer* swapchainFramebuffers = NULL;
+    PrerecordedCommandBuffers prerecordedCommandBuffers = {0};
 
-    VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
-    VkDeviceMemory depthImageMemory;
-    VkImage depthImage;
-    VkImageView depthImageView;
+    GpuAllocation depthImageAllocation = {0};
+    VkImage depthImage = VK_NULL_HANDLE;
+    VkImageView depthImageView = VK_NULL_HANDLE;
+
+    bool swapchainOutOfDate = false;
+    RetiredSwapchain retiredSwapchains[MAX_RETIRED_SWAPCHAINS];
+    u32 retiredSwapchainCount = 0;
+
+    OffscreenTarget offscreenTarget = {0};
+    if (options.headless)
+    {
+        surfaceExtent = (VkExtent2D){WINDOW_WIDTH, WINDOW_HEIGHT};
+        computeViewportAndScissor(surfaceExtent, &viewport, &scissor);
+
+        depthImage = createImage(gpuAllocator, device, surfaceExtent.width, surfaceExtent.height, 1, depthFormat,
+            VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_CATEGORY_ATTACHMENT, &depthImageAllocation);
+        depthImageView = createImageView(device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+        createOffscreenTarget(gpuAllocator, device, commandPool, renderPass, surfaceExtent, options.framesInFlight, depthImageView, options.dumpDirectory != NULL, &offscreenTarget);
+
+        // Each frame slot renders to its own image, which takes the place of
+        // a single swapchain image
+        if (options.prerecord)
+            allocatePrerecordedCommandBuffers(device, commandPool, 1, options.framesInFlight, &prerecordedCommandBuffers);
+    }
+
+    bool fixedTimeStep = options.headless || options.benchFrameCount > 0;
+    u64 startTime = getTimeNanoseconds();
+    u64 pauseStartTime = 0;
+
+    GpuFrameTimings gpuTimingHistory[GPU_TIMING_HISTORY_SIZE];
+    u32 gpuTimingHistoryCount = 0;
+    DebugView gpuTimingDebugView = g_debugView;
+    // Results arrive frames after recording, so each slot remembers the
+    // debug view its queries were recorded with
+    DebugView gpuQueryDebugViews[MAX_FRAMES_IN_FLIGHT] = {0};
+    VkExtent2D lastRenderExtent = {0, 0};
+    u64 lastGpuTimingReadout = startTime;
+
+    BenchRecorder benchRecorder = {0};
+    if (options.benchFrameCount > 0)
+        createBenchRecorder(&benchRecorder, BENCH_WARMUP_FRAME_COUNT, options.benchFrameCount);
 
     u32 currentFrame = 0;
-    while(!glfwWindowShouldClose(window))
+    while ((options.frameCount == 0 || frameNumber < options.frameCount) && !isBenchComplete(&benchRecorder)
+        && (options.headless || !glfwWindowShouldClose(window)))
     {
-        glfwPollEvents();
+        // Waiting for the last submitted frame before sampling input keeps
+        // the CPU from running ahead of the GPU, so input is applied to the
+        // very next frame at the cost of overlap between CPU and GPU work
+        if (options.lowLatency)
+        {
+            u32 previousFrame = (currentFrame + options.framesInFlight - 1) % options.framesInFlight;
+            zone = beginProfileZone("wait for previous frame");
+            waitForGpuTimelineValue(&timeline, frameTimelineValues[previousFrame]);
+            endProfileZone(zone);
+        }
+
+        if (!options.headless)
+        {
+            // Minimized windows, and on demand windows with nothing to
+            // update, sleep until an event arrives instead of spinning
+            bool minimized = windowFramebufferInfo.width == 0 && windowFramebufferInfo.height == 0;
+            bool busy = g_redrawRequested || windowFramebufferInfo.resized || swapchain == VK_NULL_HANDLE || swapchainOutOfDate || !g_rotationPaused
+                || isColorTransitionActive() || reloadBatch.timelineValue != 0 || retiredMesh.vertexBuffer != VK_NULL_HANDLE;
+            if (minimized || (options.onDemand && !busy))
+            {
+                zone = beginProfileZone("wait for events");
+                glfwWaitEvents();
+                endProfileZone(zone);
+                continue;
+            }
+
+            glfwPollEvents();
+            g_redrawRequested = false;
+        }
+
+        // Pausing shifts the start time by the paused duration, so the
+        // rotation resumes where it stopped
+        if (g_rotationPaused && pauseStartTime == 0)
+        {
+            pauseStartTime = getTimeNanoseconds();
+        }
+        else if (!g_rotationPaused && pauseStartTime != 0)
+        {
+            startTime += getTimeNanoseconds() - pauseStartTime;
+            pauseStartTime = 0;
+        }
+
+        if (g_profilerDumpRequested)
+        {
+            g_profilerDumpRequested = false;
+            if (g_profilerTracePath != NULL)
+                writeProfilerTrace(g_profilerTracePath);
+            else
+                INFORM("%s\n", "Profiling is disabled, run with --profile trace_file to record zones");
+        }
+
+        releaseUploadBatch(&uploadBatch, false);
+
+        if (g_reloadRequested)
+        {
+            g_reloadRequested = false;
+            if (reloadBatch.timelineValue != 0 || retiredMesh.vertexBuffer != VK_NULL_HANDLE)
+            {
+                INFORM("%s\n", "Previous reload still in flight, ignoring reload request");
+            }
+            else
+            {
+                zone = beginProfileZone("parse obj");
+                loadModel(options.objFilePath, &pendingModel);
+                endProfileZone(zone);
+
+                // The current mesh stays resident until the new one arrives
+                VkDeviceSize pendingMeshBuffersSize = getMeshBuffersSize(&pendingModel, options.depthPrepass);
+                updateGpuMemoryBudget(gpuAllocator);
+                if (!fitsGpuMemoryBudget(gpuAllocator, pendingMeshBuffersSize, pendingMeshBuffersSize))
+                {
+                    INFORM("%s\n", "Reloaded model does not fit in the GPU memory budget, keeping the current one");
+                    freeModel(&pendingModel);
+                }
+                else
+                {
+                    beginUploadBatch(device, gpuAllocator, &uploadQueues, &reloadBatch);
+                    createMeshBuffers(device, &reloadBatch, &pendingModel, options.depthPrepass, &pendingMesh);
+                    submitUploadBatch(&reloadBatch);
+                }
+            }
+        }
+
+        if (reloadBatch.timelineValue != 0 && releaseUploadBatch(&reloadBatch, false))
+        {
+            retiredMesh = mesh;
+            retiredMeshTimelineValue = timeline.submittedValue;
+            mesh = pendingMesh;
+            pendingMesh = (MeshBuffers){0};
+
+            freeModel(&g_model);
+            g_model = pendingModel;
+            pendingModel = (Model){0};
+
+            freeAndNull(g_drawCommands);
+            buildDrawCommands();
+
+            // Buffer handles of destroyed meshes may be reused by later ones
+            for (u32 i = 0; i < prerecordedCommandBuffers.count; i++)
+                prerecordedCommandBuffers.recorded[i] = false;
+        }
 
         if (windowFramebufferInfo.width == 0 && windowFramebufferInfo.height == 0)
             continue;
@@ -1365,144 +3820,363 @@ int main(int argc, char* argv[])
             g_colorToTextureRatio = (g_colorToTextureRatio < 0) ? 0 : g_colorToTextureRatio;
         }
 
-        if (swapchain == VK_NULL_HANDLE)
+        if (!options.headless && (swapchain == VK_NULL_HANDLE || swapchainOutOfDate))
         {
-            surfaceExtent = querySurfaceExtent(window, surfaceCapabilities);
-
-            viewport = (VkViewport){
-                .x = 0.f,
-                .y = 0.f,
-                .width = (f32)surfaceExtent.width,
-                .height = (f32)surfaceExtent.height,
-                .minDepth = 0.f,
-                .maxDepth = 1.f
-            };
+            // Size limits and transform can change along with the window
+            if (vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physicalDevice, surface, &surfaceCapabilities) != VK_SUCCESS)
+                PANIC("%s\n", "Failed to determine physical device surface capabilities");
 
-            scissor = (VkRect2D){
-                .offset = {0, 0},
-                .extent = surfaceExtent
-            };
+            VkExtent2D newSurfaceExtent = querySurfaceExtent(window, surfaceCapabilities);
+            if (newSurfaceExtent.width == 0 || newSurfaceExtent.height == 0)
+            {
+                glfwWaitEvents();
+                continue;
+            }
+
+            // Without room for another retired swapchain, wait for the oldest
+            // one to drain instead
+            if (retiredSwapchainCount == MAX_RETIRED_SWAPCHAINS)
+            {
+                waitForGpuTimelineValue(&timeline, retiredSwapchains[0].timelineValue);
+                retiredSwapchainCount = releaseRetiredSwapchains(gpuAllocator, device, commandPool, &timeline, retiredSwapchains, retiredSwapchainCount);
+            }
+
+            bool attachmentsReused = depthImage != VK_NULL_HANDLE
+                && newSurfaceExtent.width == surfaceExtent.width && newSurfaceExtent.height == surfaceExtent.height;
+
+            VkSwapchainKHR oldSwapchain = swapchain;
+            if (oldSwapchain != VK_NULL_HANDLE)
+            {
+                retiredSwapchains[retiredSwapchainCount++] = (RetiredSwapchain){
+                    .swapchain = oldSwapchain,
+                    .imageCount = swapchainImageCount,
+                    .imageViews = swapchainImageViews,
+                    .framebuffers = swapchainFramebuffers,
+                    .depthImage = attachmentsReused ? VK_NULL_HANDLE : depthImage,
+                    .depthImageView = attachmentsReused ? VK_NULL_HANDLE : depthImageView,
+                    .depthImageAllocation = attachmentsReused ? (GpuAllocation){0} : depthImageAllocation,
+                    .offscreenTarget = attachmentsReused ? (OffscreenTarget){0} : offscreenTarget,
+                    .prerecorded = prerecordedCommandBuffers,
+                    .timelineValue = timeline.submittedValue
+                };
+                freeAndNull(swapchainImages);
+                prerecordedCommandBuffers = (PrerecordedCommandBuffers){0};
+            }
+
+            surfaceExtent = newSurfaceExtent;
+            computeViewportAndScissor(surfaceExtent, &viewport, &scissor);
 
-            depthImage = createImage(physicalDevice, device, surfaceExtent.width, surfaceExtent.height, depthFormat,
-                VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthImageMemory);
-            depthImageView = createImageView(device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+            if (!attachmentsReused)
+            {
+                depthImage = createImage(gpuAllocator, device, surfaceExtent.width, surfaceExtent.height, 1, depthFormat,
+                    VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, GPU_MEMORY_CATEGORY_ATTACHMENT, &depthImageAllocation);
+                depthImageView = createImageView(device, depthImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+
+                // Allocated at full size, lower scales only render into
+                // part of it so changing the scale costs nothing
+                if (dynamicResolution)
+                    createOffscreenTarget(gpuAllocator, device, commandPool, renderPass, surfaceExtent, options.framesInFlight, depthImageView, false, &offscreenTarget);
+            }
 
-            swapchain = createSwapchain(device, surface, surfaceCapabilities, surfaceFormat, surfacePresentMode, surfaceExtent);
+            VkImageUsageFlags swapchainImageUsage = dynamicResolution ? VK_IMAGE_USAGE_TRANSFER_DST_BIT : VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+            swapchain = createSwapchain(device, surface, surfaceCapabilities, surfaceFormat, surfacePresentMode, surfaceExtent, swapchainImageUsage, oldSwapchain);
+            swapchainOutOfDate = false;
             swapchainImages = getSwapchainImages(device, swapchain, &swapchainImageCount);
-            swapchainImageViews = createSwapchainImageViews(device, swapchainImages, swapchainImageCount, surfaceFormat.format);
-            swapchainFramebuffers = createSwapchainFramebuffers(device, swapchainImageViews, swapchainImageCount, surfaceExtent, renderPass, depthImageView);
+            if (!dynamicResolution)
+            {
+                swapchainImageViews = createSwapchainImageViews(device, swapchainImages, swapchainImageCount, surfaceFormat.format);
+                if (!dynamicRendering)
+                    swapchainFramebuffers = createSwapchainFramebuffers(device, swapchainImageViews, swapchainImageCount, surfaceExtent, renderPass, depthImageView);
+            }
+
+            if (options.prerecord)
+                allocatePrerecordedCommandBuffers(device, commandPool, swapchainImageCount, options.framesInFlight, &prerecordedCommandBuffers);
         }
 
-        if (vkWaitForFences(device, 1, &inFlightFences[currentFrame], VK_TRUE, UINT64_MAX) != VK_SUCCESS)
-            PANIC("%s\n", "Failed to wait for fences");
+        zone = beginProfileZone("wait for frame slot");
+        waitForGpuTimelineValue(&timeline, frameTimelineValues[currentFrame]);
+        endProfileZone(zone);
+
+        if (retiredMesh.vertexBuffer != VK_NULL_HANDLE && isGpuTimelineValueComplete(&timeline, retiredMeshTimelineValue))
+            destroyMeshBuffers(gpuAllocator, device, &retiredMesh);
 
-        u32 imageIndex;
-        VkResult result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
-        if (result == VK_ERROR_OUT_OF_DATE_KHR)
+        if (retiredSwapchainCount > 0)
+            retiredSwapchainCount = releaseRetiredSwapchains(gpuAllocator, device, commandPool, &timeline, retiredSwapchains, retiredSwapchainCount);
+
+        if (options.dumpDirectory != NULL)
+            writeReadbackFrame(&offscreenTarget, currentFrame, &timeline, options.dumpDirectory);
+
+        // Timings of another debug view would skew the averages
+        if (gpuTimingDebugView != g_debugView)
         {
-            destroySwapchain(device, &swapchain, swapchainImageCount, swapchainImages, swapchainImageViews, swapchainFramebuffers);
-            continue;
+            gpuTimingDebugView = g_debugView;
+            gpuTimingHistoryCount = 0;
         }
-        else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+
+        // The results of this slot's last frame are complete now that the
+        // timeline has passed it
+        GpuFrameTimings gpuFrameTimings;
+        if (readGpuFrameTimings(gpuQueries, currentFrame, &gpuFrameTimings))
         {
-            PANIC("%s\n", "Failed to acquire next image from swapchain");
+            if (gpuQueryDebugViews[currentFrame] == gpuTimingDebugView)
+                gpuTimingHistory[gpuTimingHistoryCount++ % GPU_TIMING_HISTORY_SIZE] = gpuFrameTimings;
+            if (options.benchFrameCount > 0)
+                recordBenchGpuFrame(&benchRecorder, &gpuFrameTimings);
+
+            if (dynamicResolution && gpuFrameTimings.frameMilliseconds >= 0.0
+                && updateResolutionScale(&resolutionScaler, gpuFrameTimings.frameMilliseconds))
+                INFORM("%s%.2f\n", "Render scale ", resolutionScaler.scale);
         }
 
-        if (vkResetFences(device, 1, &inFlightFences[currentFrame]) != VK_SUCCESS)
-            PANIC("%s\n", "Failed to reset fences");
+        u64 now = getTimeNanoseconds();
+        if (nanosecondsToSeconds(now - lastGpuTimingReadout) >= GPU_TIMING_READOUT_INTERVAL)
+        {
+            lastGpuTimingReadout = now;
+            updateGpuMemoryBudget(gpuAllocator);
+            u64 renderPixelCount = (u64)lastRenderExtent.width * lastRenderExtent.height;
+            showGpuTimingReadout(gpuQueries, gpuTimingHistory, gpuTimingHistoryCount, g_debugView, renderPixelCount, gpuAllocator,
+                window, options.gpuTimings);
+        }
 
-        if (vkResetCommandBuffer(commandBuffers[currentFrame], 0) != VK_SUCCESS)
-            PANIC("%s\n", "Failed to reset command buffer");
-        
-        VkCommandBufferBeginInfo commandBufferBeginInfo = {.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-        if (vkBeginCommandBuffer(commandBuffers[currentFrame], &commandBufferBeginInfo) != VK_SUCCESS)
-            PANIC("%s\n", "Failed to begin command buffer");
+        u32 imageIndex = 0;
+        VkResult result;
+        if (!options.headless)
+        {
+            zone = beginProfileZone("acquire image");
+            result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, imageAvailableSemaphores[currentFrame], VK_NULL_HANDLE, &imageIndex);
+            endProfileZone(zone);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR)
+            {
+                swapchainOutOfDate = true;
+                continue;
+            }
+            else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR)
+            {
+                PANIC("%s\n", "Failed to acquire next image from swapchain");
+            }
+        }
+
+        VkExtent2D renderExtent = surfaceExtent;
+        VkViewport renderViewport = viewport;
+        VkRect2D renderScissor = scissor;
+        if (dynamicResolution)
+        {
+            renderExtent = getScaledExtent(&resolutionScaler, surfaceExtent);
+            computeViewportAndScissor(renderExtent, &renderViewport, &renderScissor);
+        }
+
+        lastRenderExtent = renderExtent;
 
-        VkClearValue clearValues[] = {{.color = {0.f, 0.f, 0.f, 1.f}}, {.depthStencil = {1.0f, 0}}};
-        VkRenderPassBeginInfo renderPassBeginInfo = {
-            .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+        CullVariant cullVariant = (mesh.closed && !options.disableCulling) ? CULL_VARIANT_BACK : CULL_VARIANT_NONE;
+        FrameRecordInfo frameRecordInfo = {
             .renderPass = renderPass,
-            .framebuffer = swapchainFramebuffers[imageIndex],
-            .renderArea = {
-                .offset = {0, 0},
-                .extent = surfaceExtent
-            },
-            .clearValueCount = ARR_LEN(clearValues),
-            .pClearValues = clearValues
+            .framebuffer = dynamicRendering ? VK_NULL_HANDLE : offscreenColor ? offscreenTarget.framebuffers[currentFrame] : swapchainFramebuffers[imageIndex],
+            .extent = renderExtent,
+            .viewport = renderViewport,
+            .scissor = renderScissor,
+            .pipeline = graphicsPipelines[cullVariant][pickShadingMode(g_colorToTextureRatio, g_debugView)],
+            .pipelineLayout = pipelineLayout,
+            .descriptorSet = descriptorSets[currentFrame],
+            .vertexBuffer = mesh.vertexBuffer,
+            .indexBuffer = mesh.indexBuffer,
+            .gpuQueries = gpuQueries,
+            .depthPrepassPipeline = depthPrepassPipelines[cullVariant],
+            .positionBuffer = mesh.positionBuffer,
+            .colorImage = offscreenColor ? offscreenTarget.colorImages[currentFrame] : swapchainImages[imageIndex],
+            .colorImageView = offscreenColor ? offscreenTarget.colorImageViews[currentFrame] : swapchainImageViews[imageIndex],
+            .colorFormat = colorFormat,
+            .colorFinalLayout = colorFinalLayout,
+            .depthImage = depthImage,
+            .depthImageView = depthImageView,
+            .depthFormat = depthFormat,
+            .upscaleSource = dynamicResolution ? offscreenTarget.colorImages[currentFrame] : VK_NULL_HANDLE,
+            .upscaleTarget = dynamicResolution ? swapchainImages[imageIndex] : VK_NULL_HANDLE,
+            .upscaleTargetExtent = surfaceExtent
         };
 
-        vkCmdBeginRenderPass(commandBuffers[currentFrame], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
-        vkCmdBindPipeline(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-        vkCmdSetViewport(commandBuffers[currentFrame], 0, 1, &viewport);
-        vkCmdSetScissor(commandBuffers[currentFrame], 0, 1, &scissor);
+        zone = beginProfileZone("record frame");
+        VkCommandBuffer frameCommandBuffer = commandBuffers[currentFrame];
+        if (options.prerecord)
+        {
+            frameCommandBuffer = getPrerecordedCommandBuffer(&prerecordedCommandBuffers, &frameRecordInfo, imageIndex, currentFrame);
+        }
+        else
+        {
+            if (vkResetCommandBuffer(frameCommandBuffer, 0) != VK_SUCCESS)
+                PANIC("%s\n", "Failed to reset command buffer");
+
+            recordFrameCommandBuffer(frameCommandBuffer, &frameRecordInfo, (options.recordThreadCount > 0) ? &parallelRecorder : NULL, currentFrame);
+        }
 
-        VkBuffer vertexBuffers[] = {vertexBuffer};
-        VkDeviceSize vertexBufferOffsets[] = {0};
-        vkCmdBindVertexBuffers(commandBuffers[currentFrame], 0, 1, vertexBuffers, vertexBufferOffsets);
-        vkCmdBindIndexBuffer(commandBuffers[currentFrame], indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+        endProfileZone(zone);
 
-        vkCmdBindDescriptorSets(commandBuffers[currentFrame], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[currentFrame], 0, NULL);
-        vkCmdDrawIndexed(commandBuffers[currentFrame], g_indexCount, 1, 0, 0, 0);
-        vkCmdEndRenderPass(commandBuffers[currentFrame]);
+        zone = beginProfileZone("update uniform buffer");
+        updateUniformBuffer(uniformBuffersMapped, surfaceExtent, currentFrame, getAnimationTime(fixedTimeStep, frameNumber, startTime, pauseStartTime));
+        endProfileZone(zone);
 
-        if (vkEndCommandBuffer(commandBuffers[currentFrame]) != VK_SUCCESS)
-            PANIC("%s\n", "Failed to end command buffer");
-        
-        updateUniformBuffer(uniformBuffersMapped, surfaceExtent, currentFrame);
+        frameTimelineValues[currentFrame] = advanceGpuTimeline(&timeline);
+
+        // Dumped frames are copied out by a separate command buffer in the
+        // same submission, so the frame itself is recorded the same way
+        VkCommandBuffer submitCommandBuffers[] = {frameCommandBuffer, VK_NULL_HANDLE};
+        u32 submitCommandBufferCount = 1;
+        if (options.dumpDirectory != NULL)
+        {
+            submitCommandBuffers[submitCommandBufferCount++] = offscreenTarget.readbackCommandBuffers[currentFrame];
+            offscreenTarget.readbackTimelineValues[currentFrame] = frameTimelineValues[currentFrame];
+            offscreenTarget.readbackFrameNumbers[currentFrame] = frameNumber;
+        }
+
+        // The binary semaphore value is ignored
+        VkSemaphore signalSemaphores[] = {timeline.semaphore, renderFinishedSemaphores[currentFrame]};
+        u64 signalValues[] = {frameTimelineValues[currentFrame], 0};
+        VkTimelineSemaphoreSubmitInfo timelineSubmitInfo = {
+            .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+            .signalSemaphoreValueCount = options.headless ? 1 : ARR_LEN(signalValues),
+            .pSignalSemaphoreValues = signalValues
+        };
 
-        VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame]};
         VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame]};
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        // Upscaled frames first touch the swapchain image in the blit
+        VkPipelineStageFlags waitStages[] = {dynamicResolution ? VK_PIPELINE_STAGE_TRANSFER_BIT : VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
         VkSubmitInfo submitInfo = {
             .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-            .waitSemaphoreCount = ARR_LEN(waitSemaphores),
+            .pNext = &timelineSubmitInfo,
+            .waitSemaphoreCount = options.headless ? 0 : ARR_LEN(waitSemaphores),
             .pWaitSemaphores = waitSemaphores,
             .pWaitDstStageMask = waitStages,
-            .commandBufferCount = 1,
-            .pCommandBuffers = &commandBuffers[currentFrame],
-            .signalSemaphoreCount = ARR_LEN(signalSemaphores),
+            .commandBufferCount = submitCommandBufferCount,
+            .pCommandBuffers = submitCommandBuffers,
+            .signalSemaphoreCount = options.headless ? 1 : ARR_LEN(signalSemaphores),
             .pSignalSemaphores = signalSemaphores
         };
 
-        if (vkQueueSubmit(queue, 1, &submitInfo, inFlightFences[currentFrame]) != VK_SUCCESS)
+        zone = beginProfileZone("submit frame");
+        if (vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE) != VK_SUCCESS)
             PANIC("%s\n", "Failed to submit command buffers to queue");
+        endProfileZone(zone);
+
+        // Submissions are throttled by the waits on the frame slots, so in
+        // steady state the time between them is the frame time
+        if (options.benchFrameCount > 0)
+            recordBenchFrame(&benchRecorder);
+
+        markGpuQueriesSubmitted(gpuQueries, currentFrame);
+        gpuQueryDebugViews[currentFrame] = g_debugView;
+
+        if (options.headless)
+        {
+            currentFrame = (currentFrame + 1) % options.framesInFlight;
+            frameNumber++;
+            continue;
+        }
 
         VkPresentInfoKHR presentInfo = {
             .sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
-            .waitSemaphoreCount = ARR_LEN(signalSemaphores),
-            .pWaitSemaphores = signalSemaphores,
+            .waitSemaphoreCount = 1,
+            .pWaitSemaphores = &renderFinishedSemaphores[currentFrame],
             .swapchainCount = 1,
             .pSwapchains = &swapchain,
             .pImageIndices = &imageIndex
         };
 
+        zone = beginProfileZone("present");
         result = vkQueuePresentKHR(queue, &presentInfo);
+        endProfileZone(zone);
 
         if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || windowFramebufferInfo.resized)
         {
             windowFramebufferInfo.resized = false;
-            destroySwapchain(device, &swapchain, swapchainImageCount, swapchainImages, swapchainImageViews, swapchainFramebuffers);
+            swapchainOutOfDate = true;
         }
         else if (result != VK_SUCCESS)
         {
             PANIC("%s\n", "Failed to queue presentation");
         }
         
-        currentFrame = (currentFrame + 1) % MAX_FRAMES_IN_FLIGHT;
+        currentFrame = (currentFrame + 1) % options.framesInFlight;
+        frameNumber++;
     }
 
     if (vkDeviceWaitIdle(device) != VK_SUCCESS)
         PANIC("%s\n", "Failed to wait for device to be idle");
 
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++)
+    releaseUploadBatch(&uploadBatch, true);
+    releaseUploadBatch(&reloadBatch, true);
+
+    // Closing the window early leaves an incomplete benchmark without a report
+    if (options.benchFrameCount > 0)
+    {
+        if (isBenchComplete(&benchRecorder))
+        {
+            VkPhysicalDeviceProperties physicalDeviceProperties;
+            vkGetPhysicalDeviceProperties(physicalDevice, &physicalDeviceProperties);
+
+            BenchReportInfo benchReportInfo = {
+                .deviceName = physicalDeviceProperties.deviceName,
+                .width = surfaceExtent.width,
+                .height = surfaceExtent.height,
+                .trianglesPerFrame = g_model.indexCount / 3,
+                .headless = options.headless,
+                .prerecord = options.prerecord,
+                .recordThreadCount = options.recordThreadCount,
+                .framesInFlight = options.framesInFlight,
+                .presentMode = options.headless ? NULL : getPresentModeName(surfacePresentMode),
+                .lowLatency = options.lowLatency,
+                .depthPrepass = options.depthPrepass,
+                .backFaceCulling = mesh.closed && !options.disableCulling,
+                .dynamicRendering = dynamicRendering,
+                .gpuQueries = gpuQueries
+            };
+            writeBenchReport(&benchRecorder, &benchReportInfo, stdout);
+        }
+
+        destroyBenchRecorder(&benchRecorder);
+    }
+
+    // Taken while everything is still allocated, the peaks cover the run
+    if (options.memoryReport)
+    {
+        updateGpuMemoryBudget(gpuAllocator);
+        writeGpuMemoryReport(gpuAllocator, stderr);
+    }
+
+    // Oldest slot first so the last frames are written in order
+    if (options.dumpDirectory != NULL)
+    {
+        for (u32 i = 0; i < options.framesInFlight; i++)
+            writeReadbackFrame(&offscreenTarget, (currentFrame + i) % options.framesInFlight, &timeline, options.dumpDirectory);
+    }
+
+    if (offscreenTarget.slotCount > 0)
+        destroyOffscreenTarget(gpuAllocator, device, commandPool, &offscreenTarget);
+
+    for (u32 i = 0; i < options.framesInFlight; i++)
     {
         vkDestroySemaphore(device, imageAvailableSemaphores[i], NULL);
         vkDestroySemaphore(device, renderFinishedSemaphores[i], NULL);
-        vkDestroyFence(device, inFlightFences[i], NULL);
     }
 
+    if (options.recordThreadCount > 0)
+        destroyParallelRecorder(&parallelRecorder);
+
+    savePipelineCache(device, pipelineCache);
+
+    // Retired swapchains free their command buffers from the pool as well,
+    // and the device is idle so all of them are released
+    freePrerecordedCommandBuffers(device, commandPool, &prerecordedCommandBuffers);
+    retiredSwapchainCount = releaseRetiredSwapchains(gpuAllocator, device, commandPool, &timeline, retiredSwapchains, retiredSwapchainCount);
+    ASSERT(retiredSwapchainCount == 0);
     vkDestroyCommandPool(device, commandPool, NULL);
-    vkDestroyPipeline(device, graphicsPipeline, NULL);
+    vkDestroyCommandPool(device, transferCommandPool, NULL);
+    vkDestroyPipelineCache(device, pipelineCache, NULL);
+    for (u32 i = 0; i < CULL_VARIANT_COUNT; i++)
+    {
+        for (u32 j = 0; j < SHADING_MODE_COUNT; j++)
+            vkDestroyPipeline(device, graphicsPipelines[i][j], NULL);
+        if (depthPrepassPipelines[i] != VK_NULL_HANDLE)
+            vkDestroyPipeline(device, depthPrepassPipelines[i], NULL);
+    }
     vkDestroyPipelineLayout(device, pipelineLayout, NULL);
     vkDestroyDescriptorPool(device, descriptorPool, NULL);
     vkDestroyDescriptorSetLayout(device, descriptorSetLayout, NULL);
@@ -1510,27 +4184,29 @@ int main(int argc, char* argv[])
 
     if (swapchain != VK_NULL_HANDLE)
         destroySwapchain(device, &swapchain, swapchainImageCount, swapchainImages, swapchainImageViews, swapchainFramebuffers);
-
     vkDestroySampler(device, textureSampler, NULL);
     vkDestroyImageView(device, textureImageView, NULL);
     vkDestroyImage(device, textureImage, NULL);
-    vkFreeMemory(device, textureImageMemory, NULL);
+    freeGpuMemory(gpuAllocator, &textureImageAllocation);
 
     vkDestroyImageView(device, depthImageView, NULL);
     vkDestroyImage(device, depthImage, NULL);
-    vkFreeMemory(device, depthImageMemory, NULL);
+    freeGpuMemory(gpuAllocator, &depthImageAllocation);
 
-    vkDestroyBuffer(device, indexBuffer, NULL);
-    vkFreeMemory(device, indexBufferMemory, NULL);
+    destroyMeshBuffers(gpuAllocator, device, &mesh);
+    destroyMeshBuffers(gpuAllocator, device, &pendingMesh);
+    freeModel(&pendingModel);
+    destroyMeshBuffers(gpuAllocator, device, &retiredMesh);
 
-    vkDestroyBuffer(device, vertexBuffer, NULL);
-    vkFreeMemory(device, vertexBufferMemory, NULL);
-
-    for (u32 i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (u32 i = 0; i < options.framesInFlight; i++) {
         vkDestroyBuffer(device, uniformBuffers[i], NULL);
-        vkFreeMemory(device, uniformBuffersMemory[i], NULL);
+        freeGpuMemory(gpuAllocator, &uniformBuffersAllocations[i]);
     }
 
+    destroyGpuQueries(gpuQueries);
+    destroyGpuAllocator(gpuAllocator);
+    destroyGpuTimeline(&timeline);
+
     vkDestroyDevice(device, NULL);
     vkDestroySurfaceKHR(instance, surface, NULL);
     vkDestroyInstance(instance, NULL);
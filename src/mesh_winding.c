@@ -0,0 +1,197 @@
+#include "mesh_winding.h"
+
+#include <string.h>
+
+#define UNVISITED 0
+#define KEPT 1
+#define FLIPPED 2
+
+typedef struct
+{
+    Index low;
+    Index high;
+    u32 triangle;
+    // The triangle runs the edge from low to high
+    bool forward;
+} HalfEdge;
+
+static int compareHalfEdges(const void* left, const void* right)
+{
+    const HalfEdge* a = left;
+    const HalfEdge* b = right;
+    if (a->low != b->low)
+        return (a->low < b->low) ? -1 : 1;
+    if (a->high != b->high)
+        return (a->high < b->high) ? -1 : 1;
+    return 0;
+}
+
+static bool isTriangleValid(const Index* triangle, u32 vertexCount)
+{
+    return triangle[0] < vertexCount && triangle[1] < vertexCount && triangle[2] < vertexCount
+        && triangle[0] != triangle[1] && triangle[1] != triangle[2] && triangle[0] != triangle[2];
+}
+
+static void flipTriangle(Index* triangle)
+{
+    Index temp = triangle[1];
+    triangle[1] = triangle[2];
+    triangle[2] = temp;
+}
+
+// Six times the signed volume of the tetrahedron between the triangle and
+// the origin. Summed over a closed surface this is positive exactly when its
+// triangles are counter-clockwise seen from outside, wherever the origin is.
+static f64 getSignedVolume(const Vertex* vertices, const Index* triangle)
+{
+    Vec3 a = vertices[triangle[0]].pos;
+    Vec3 b = vertices[triangle[1]].pos;
+    Vec3 c = vertices[triangle[2]].pos;
+    return dotVec3(a, crossVec3(b, c));
+}
+
+void orientMeshWinding(const Vertex* vertices, u32 vertexCount, Index* indices, u32 indexCount, MeshWindingReport* outReport)
+{
+    ASSERT(indexCount % 3 == 0);
+    ASSERT(outReport != NULL);
+
+    u32 triangleCount = indexCount / 3;
+    *outReport = (MeshWindingReport){
+        .triangleCount = triangleCount,
+        .closed = triangleCount > 0
+    };
+
+    if (triangleCount == 0)
+        return;
+
+    HalfEdge* halfEdges = mallocOrDie(indexCount * sizeof(HalfEdge));
+    u32 halfEdgeCount = 0;
+    for (u32 i = 0; i < triangleCount; i++)
+    {
+        const Index* triangle = indices + i * 3;
+        if (!isTriangleValid(triangle, vertexCount))
+        {
+            outReport->closed = false;
+            continue;
+        }
+
+        for (u32 j = 0; j < 3; j++)
+        {
+            Index from = triangle[j];
+            Index to = triangle[(j + 1) % 3];
+            halfEdges[halfEdgeCount++] = (HalfEdge){
+                .low = (from < to) ? from : to,
+                .high = (from < to) ? to : from,
+                .triangle = i,
+                .forward = from < to
+            };
+        }
+    }
+
+    qsort(halfEdges, halfEdgeCount, sizeof(HalfEdge), compareHalfEdges);
+
+    // Triangles are linked across edges that exactly two of them share. A
+    // link records whether both run the edge the same way, which means they
+    // disagree on winding. Edges shared by one or more than two triangles
+    // are boundaries or seams and neither link nor orient anything.
+    u32* neighbors = mallocOrDie(indexCount * sizeof(u32));
+    bool* sameDirections = mallocOrDie(indexCount * sizeof(bool));
+    u8* neighborCounts = mallocOrDie(triangleCount * sizeof(u8));
+    memset(neighborCounts, 0, triangleCount * sizeof(u8));
+
+    for (u32 i = 0; i < halfEdgeCount;)
+    {
+        u32 end = i + 1;
+        while (end < halfEdgeCount && compareHalfEdges(&halfEdges[i], &halfEdges[end]) == 0)
+            end++;
+
+        if (end - i == 2)
+        {
+            const HalfEdge* a = &halfEdges[i];
+            const HalfEdge* b = &halfEdges[i + 1];
+            bool sameDirection = a->forward == b->forward;
+
+            u32 slot = a->triangle * 3 + neighborCounts[a->triangle]++;
+            neighbors[slot] = b->triangle;
+            sameDirections[slot] = sameDirection;
+
+            slot = b->triangle * 3 + neighborCounts[b->triangle]++;
+            neighbors[slot] = a->triangle;
+            sameDirections[slot] = sameDirection;
+        }
+        else
+        {
+            outReport->closed = false;
+        }
+
+        i = end;
+    }
+
+    freeAndNull(halfEdges);
+
+    // Walks each connected piece from an arbitrary seed, deciding for every
+    // triangle whether it must be flipped to agree with the seed. Meeting a
+    // triangle again with the opposite decision means the piece cannot be
+    // oriented at all, like a Moebius strip.
+    u8* states = mallocOrDie(triangleCount * sizeof(u8));
+    memset(states, UNVISITED, triangleCount * sizeof(u8));
+    u32* queue = mallocOrDie(triangleCount * sizeof(u32));
+
+    for (u32 seed = 0; seed < triangleCount; seed++)
+    {
+        if (states[seed] != UNVISITED || !isTriangleValid(indices + seed * 3, vertexCount))
+            continue;
+
+        outReport->componentCount++;
+
+        u32 head = 0;
+        u32 tail = 0;
+        queue[tail++] = seed;
+        states[seed] = KEPT;
+
+        f64 volume = 0.0;
+        while (head < tail)
+        {
+            u32 triangle = queue[head++];
+            bool flipped = states[triangle] == FLIPPED;
+            f64 triangleVolume = getSignedVolume(vertices, indices + triangle * 3);
+            volume += flipped ? -triangleVolume : triangleVolume;
+
+            for (u32 i = 0; i < neighborCounts[triangle]; i++)
+            {
+                u32 slot = triangle * 3 + i;
+                u32 neighbor = neighbors[slot];
+                bool neighborFlipped = flipped != sameDirections[slot];
+
+                if (states[neighbor] == UNVISITED)
+                {
+                    states[neighbor] = neighborFlipped ? FLIPPED : KEPT;
+                    queue[tail++] = neighbor;
+                }
+                else if ((states[neighbor] == FLIPPED) != neighborFlipped)
+                {
+                    outReport->closed = false;
+                }
+            }
+        }
+
+        // For open pieces the volume is only a guess, measured from the
+        // origin, which the model is centered on
+        bool turnAround = volume < 0.0;
+        for (u32 i = 0; i < tail; i++)
+        {
+            u32 triangle = queue[i];
+            if ((states[triangle] == FLIPPED) != turnAround)
+            {
+                flipTriangle(indices + triangle * 3);
+                outReport->flippedTriangleCount++;
+            }
+        }
+    }
+
+    freeAndNull(queue);
+    freeAndNull(states);
+    freeAndNull(neighborCounts);
+    freeAndNull(sameDirections);
+    freeAndNull(neighbors);
+}
@@ -0,0 +1,24 @@
+#ifndef MESH_WINDING_H
+#define MESH_WINDING_H
+
+#include "util.h"
+#include "obj_parser.h"
+
+typedef struct
+{
+    u32 triangleCount;
+    u32 flippedTriangleCount;
+    u32 componentCount;
+    // Every edge is shared by exactly two triangles with opposite winding,
+    // so no back face can ever be seen from outside the mesh
+    bool closed;
+} MeshWindingReport;
+
+// Flips triangles so that neighbours agree on their winding, then flips
+// whole connected pieces whose triangles turn out to face inward. Outward
+// faces end up counter-clockwise. Degenerate triangles and triangles that
+// reference missing vertices are left alone and keep the mesh from being
+// reported as closed.
+void orientMeshWinding(const Vertex* vertices, u32 vertexCount, Index* indices, u32 indexCount, MeshWindingReport* outReport);
+
+#endif
@@ -0,0 +1,176 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "pipeline_cache.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define PIPELINE_CACHE_DIR_NAME "scop"
+#define PIPELINE_CACHE_FILE_NAME "pipeline_cache.bin"
+#define PIPELINE_CACHE_PATH_SIZE 4096
+
+static bool makeDirectory(const char* path)
+{
+    if (mkdir(path, 0755) == 0 || errno == EEXIST)
+        return true;
+
+    INFORM("%s%s\n", "Failed to create directory: ", path);
+    return false;
+}
+
+// Resolves $XDG_CACHE_HOME/scop, falling back to $HOME/.cache/scop. The
+// directories are created on demand when createDirectories is set.
+static bool getPipelineCachePath(char* outPath, usize outPathSize, bool createDirectories)
+{
+    char directory[PIPELINE_CACHE_PATH_SIZE];
+    const char* cacheHome = getenv("XDG_CACHE_HOME");
+    if (cacheHome != NULL && cacheHome[0] != '\0')
+    {
+        if (snprintf(directory, sizeof(directory), "%s", cacheHome) >= (int)sizeof(directory))
+            return false;
+    }
+    else
+    {
+        const char* home = getenv("HOME");
+        if (home == NULL || home[0] == '\0')
+            return false;
+        if (snprintf(directory, sizeof(directory), "%s/.cache", home) >= (int)sizeof(directory))
+            return false;
+    }
+
+    if (createDirectories && !makeDirectory(directory))
+        return false;
+
+    usize length = strlen(directory);
+    if (snprintf(directory + length, sizeof(directory) - length, "/%s", PIPELINE_CACHE_DIR_NAME) >= (int)(sizeof(directory) - length))
+        return false;
+
+    if (createDirectories && !makeDirectory(directory))
+        return false;
+
+    return snprintf(outPath, outPathSize, "%s/%s", directory, PIPELINE_CACHE_FILE_NAME) < (int)outPathSize;
+}
+
+static void* readPipelineCacheFile(const char* path, size_t* outSize)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return NULL;
+
+    void* data = NULL;
+    long fileSize = -1;
+    if (fseek(file, 0, SEEK_END) == 0)
+        fileSize = ftell(file);
+
+    if (fileSize > 0 && fseek(file, 0, SEEK_SET) == 0)
+    {
+        data = mallocOrDie((size_t)fileSize);
+        if (fread(data, 1, (size_t)fileSize, file) != (size_t)fileSize)
+            freeAndNull(data);
+    }
+
+    if (fclose(file) == EOF)
+        INFORM("%s%s\n", "Failed to close file: ", path);
+
+    *outSize = (data != NULL) ? (size_t)fileSize : 0;
+    return data;
+}
+
+static bool isPipelineCacheCompatible(VkPhysicalDevice physicalDevice, const void* data, size_t size)
+{
+    VkPipelineCacheHeaderVersionOne header;
+    if (size < sizeof(header))
+        return false;
+    memcpy(&header, data, sizeof(header));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+    return header.headerSize >= sizeof(header) && header.headerSize <= size
+        && header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+        && header.vendorID == properties.vendorID
+        && header.deviceID == properties.deviceID
+        && memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache loadPipelineCache(VkPhysicalDevice physicalDevice, VkDevice device)
+{
+    // Vulkan takes sizes as size_t, which usize does not always match
+    size_t dataSize = 0;
+    void* data = NULL;
+
+    char path[PIPELINE_CACHE_PATH_SIZE];
+    if (getPipelineCachePath(path, sizeof(path), false))
+        data = readPipelineCacheFile(path, &dataSize);
+
+    if (data != NULL && !isPipelineCacheCompatible(physicalDevice, data, dataSize))
+    {
+        INFORM("%s%s\n", "Discarding incompatible pipeline cache: ", path);
+        freeAndNull(data);
+        dataSize = 0;
+    }
+
+    VkPipelineCacheCreateInfo createInfo = {
+        .sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+        .initialDataSize = dataSize,
+        .pInitialData = data
+    };
+
+    VkPipelineCache pipelineCache;
+    if (vkCreatePipelineCache(device, &createInfo, NULL, &pipelineCache) != VK_SUCCESS)
+    {
+        // Drivers may still reject data that passed the header check
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = NULL;
+        if (vkCreatePipelineCache(device, &createInfo, NULL, &pipelineCache) != VK_SUCCESS)
+            PANIC("%s\n", "Failed to create pipeline cache");
+    }
+
+    freeAndNull(data);
+
+    return pipelineCache;
+}
+
+void savePipelineCache(VkDevice device, VkPipelineCache pipelineCache)
+{
+    char path[PIPELINE_CACHE_PATH_SIZE];
+    char tempPath[PIPELINE_CACHE_PATH_SIZE + 4];
+    if (!getPipelineCachePath(path, sizeof(path), true))
+    {
+        INFORM("%s\n", "Failed to determine pipeline cache path");
+        return;
+    }
+    snprintf(tempPath, sizeof(tempPath), "%s.tmp", path);
+
+    size_t dataSize = 0;
+    if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, NULL) != VK_SUCCESS || dataSize == 0)
+        return;
+
+    void* data = mallocOrDie(dataSize);
+    if (vkGetPipelineCacheData(device, pipelineCache, &dataSize, data) != VK_SUCCESS)
+    {
+        freeAndNull(data);
+        return;
+    }
+
+    // Written to a temporary file first so that a crash or a concurrent
+    // instance never leaves a truncated cache behind.
+    FILE* file = fopen(tempPath, "wb");
+    if (file == NULL)
+    {
+        INFORM("%s%s\n", "Failed to open file: ", tempPath);
+        freeAndNull(data);
+        return;
+    }
+
+    bool written = fwrite(data, 1, dataSize, file) == dataSize;
+    written &= (fclose(file) == 0);
+    freeAndNull(data);
+
+    if (!written || rename(tempPath, path) != 0)
+    {
+        INFORM("%s%s\n", "Failed to write pipeline cache: ", path);
+        remove(tempPath);
+    }
+}
@@ -0,0 +1,14 @@
+#ifndef PIPELINE_CACHE_H
+#define PIPELINE_CACHE_H
+
+#include "util.h"
+
+#include <vulkan/vulkan.h>
+
+// Creates a pipeline cache seeded from the per-user cache file. Data written
+// by a different driver or device is discarded and an empty cache is returned.
+VkPipelineCache loadPipelineCache(VkPhysicalDevice physicalDevice, VkDevice device);
+
+void savePipelineCache(VkDevice device, VkPipelineCache pipelineCache);
+
+#endif
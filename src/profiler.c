@@ -0,0 +1,177 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "profiler.h"
+#include "timer.h"
+
+#include <pthread.h>
+#include <string.h>
+
+typedef struct
+{
+    const char* name;
+    u64 start;
+    u64 end;
+} ProfileEvent;
+
+// Threads are never unregistered so their zones can still be exported after
+// they exit
+typedef struct ProfilerThread
+{
+    ProfileEvent* events;
+    u64 eventCount;
+    u32 id;
+    char name[32];
+    struct ProfilerThread* next;
+} ProfilerThread;
+
+static bool g_profilerEnabled = false;
+static u64 g_profilerStartTime = 0;
+static pthread_key_t g_profilerThreadKey;
+static pthread_mutex_t g_profilerThreadsMutex = PTHREAD_MUTEX_INITIALIZER;
+static ProfilerThread* g_profilerThreads = NULL;
+static u32 g_profilerThreadCount = 0;
+
+void initProfiler(bool enabled)
+{
+    g_profilerEnabled = enabled;
+    if (!enabled)
+        return;
+
+    if (pthread_key_create(&g_profilerThreadKey, NULL) != 0)
+        PANIC("%s\n", "Failed to create profiler thread key");
+
+    g_profilerStartTime = getTimeNanoseconds();
+}
+
+void shutdownProfiler(void)
+{
+    if (!g_profilerEnabled)
+        return;
+
+    g_profilerEnabled = false;
+    pthread_key_delete(g_profilerThreadKey);
+
+    pthread_mutex_lock(&g_profilerThreadsMutex);
+    while (g_profilerThreads != NULL)
+    {
+        ProfilerThread* thread = g_profilerThreads;
+        g_profilerThreads = thread->next;
+        freeAndNull(thread->events);
+        free(thread);
+    }
+    g_profilerThreadCount = 0;
+    pthread_mutex_unlock(&g_profilerThreadsMutex);
+}
+
+bool isProfilerEnabled(void)
+{
+    return g_profilerEnabled;
+}
+
+static ProfilerThread* getProfilerThread(void)
+{
+    ProfilerThread* thread = pthread_getspecific(g_profilerThreadKey);
+    if (thread != NULL)
+        return thread;
+
+    thread = mallocOrDie(sizeof(ProfilerThread));
+    *thread = (ProfilerThread){.events = mallocOrDie(PROFILER_THREAD_EVENT_COUNT * sizeof(ProfileEvent))};
+
+    pthread_mutex_lock(&g_profilerThreadsMutex);
+    thread->id = ++g_profilerThreadCount;
+    thread->next = g_profilerThreads;
+    g_profilerThreads = thread;
+    pthread_mutex_unlock(&g_profilerThreadsMutex);
+
+    snprintf(thread->name, sizeof(thread->name), "thread %u", thread->id);
+
+    if (pthread_setspecific(g_profilerThreadKey, thread) != 0)
+        PANIC("%s\n", "Failed to register profiler thread");
+
+    return thread;
+}
+
+void setProfilerThreadName(const char* name)
+{
+    if (!g_profilerEnabled)
+        return;
+
+    ProfilerThread* thread = getProfilerThread();
+    snprintf(thread->name, sizeof(thread->name), "%s", name);
+}
+
+ProfileZone beginProfileZone(const char* name)
+{
+    if (!g_profilerEnabled)
+        return (ProfileZone){0};
+
+    return (ProfileZone){.name = name, .start = getTimeNanoseconds()};
+}
+
+void endProfileZone(ProfileZone zone)
+{
+    if (!g_profilerEnabled || zone.name == NULL)
+        return;
+
+    u64 end = getTimeNanoseconds();
+    ProfilerThread* thread = getProfilerThread();
+
+    // Once full the oldest zones are overwritten
+    thread->events[thread->eventCount % PROFILER_THREAD_EVENT_COUNT] = (ProfileEvent){
+        .name = zone.name,
+        .start = zone.start,
+        .end = end
+    };
+    thread->eventCount++;
+}
+
+void writeProfilerTrace(const char* filename)
+{
+    if (!g_profilerEnabled)
+        return;
+
+    FILE* file = fopen(filename, "w");
+    if (file == NULL)
+    {
+        INFORM("%s%s\n", "Failed to open profiler trace file: ", filename);
+        return;
+    }
+
+    fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+    u64 writtenEventCount = 0;
+    const char* separator = "";
+
+    pthread_mutex_lock(&g_profilerThreadsMutex);
+    for (ProfilerThread* thread = g_profilerThreads; thread != NULL; thread = thread->next)
+    {
+        fprintf(file, "%s{\"ph\": \"M\", \"name\": \"thread_name\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ", separator, thread->id);
+        writeJsonString(file, thread->name);
+        fprintf(file, "}}");
+        separator = ",\n";
+
+        u64 count = (thread->eventCount < PROFILER_THREAD_EVENT_COUNT) ? thread->eventCount : PROFILER_THREAD_EVENT_COUNT;
+        for (u64 i = thread->eventCount - count; i < thread->eventCount; i++)
+        {
+            const ProfileEvent* event = &thread->events[i % PROFILER_THREAD_EVENT_COUNT];
+
+            // Chrome traces use microseconds
+            fprintf(file, "%s{\"ph\": \"X\", \"name\": ", separator);
+            writeJsonString(file, event->name);
+            fprintf(file, ", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}", thread->id,
+                (event->start - g_profilerStartTime) / 1e3, (event->end - event->start) / 1e3);
+        }
+        writtenEventCount += count;
+    }
+    pthread_mutex_unlock(&g_profilerThreadsMutex);
+
+    fprintf(file, "\n]}\n");
+
+    if (fclose(file) != 0)
+    {
+        INFORM("%s%s\n", "Failed to write profiler trace file: ", filename);
+        return;
+    }
+
+    INFORM("%s%llu%s%s\n", "Wrote ", (unsigned long long)writtenEventCount, " profiler zones to ", filename);
+}
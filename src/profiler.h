@@ -0,0 +1,35 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "util.h"
+
+// Scoped CPU timing zones recorded into per-thread ring buffers and exported
+// as a Chrome trace_event JSON file, viewable in chrome://tracing or
+// Perfetto. Zones cost a clock read and a store when enabled and a branch
+// when not.
+typedef struct
+{
+    const char* name;
+    u64 start;
+} ProfileZone;
+
+#define PROFILER_THREAD_EVENT_COUNT 65536
+
+void initProfiler(bool enabled);
+void shutdownProfiler(void);
+
+bool isProfilerEnabled(void);
+
+// Names the calling thread in exported traces
+void setProfilerThreadName(const char* name);
+
+// name must outlive the profiler, in practice a string literal
+ProfileZone beginProfileZone(const char* name);
+void endProfileZone(ProfileZone zone);
+
+// Writes the most recent zones of every thread. Threads must not record
+// zones while this runs, which holds for scop's worker threads whenever the
+// main thread is outside runWorkerTask.
+void writeProfilerTrace(const char* filename);
+
+#endif
@@ -0,0 +1,80 @@
+#include "resolution_scaler.h"
+
+#include <math.h>
+
+#define SMOOTHING 0.2
+#define MIN_SAMPLE_COUNT 4
+#define SETTLE_FRAME_COUNT 6
+// The scale only rises once frames are comfortably under budget, so it does
+// not oscillate around it, and then aims a bit below the budget
+#define RAISE_THRESHOLD 0.8
+#define TARGET_FRACTION 0.9
+// Drops quickly on a spike, recovers gradually
+#define MAX_DECREASE_FACTOR 0.5
+#define MAX_INCREASE_FACTOR 1.1
+#define MIN_SCALE_CHANGE 0.01f
+
+void createResolutionScaler(ResolutionScaler* scaler, f64 budgetMilliseconds, f32 minScale, f32 maxScale)
+{
+    ASSERT(budgetMilliseconds > 0.0);
+    ASSERT(minScale > 0.0f && minScale <= maxScale);
+
+    *scaler = (ResolutionScaler){
+        .budgetMilliseconds = budgetMilliseconds,
+        .minScale = minScale,
+        .maxScale = maxScale,
+        .scale = maxScale
+    };
+}
+
+bool updateResolutionScale(ResolutionScaler* scaler, f64 gpuFrameMilliseconds)
+{
+    if (scaler->settleFrameCount > 0)
+    {
+        scaler->settleFrameCount--;
+        return false;
+    }
+
+    if (scaler->sampleCount == 0)
+        scaler->averageMilliseconds = gpuFrameMilliseconds;
+    else
+        scaler->averageMilliseconds += (gpuFrameMilliseconds - scaler->averageMilliseconds) * SMOOTHING;
+    scaler->sampleCount++;
+
+    f64 average = scaler->averageMilliseconds;
+    if (scaler->sampleCount < MIN_SAMPLE_COUNT || average <= 0.0)
+        return false;
+
+    if (average <= scaler->budgetMilliseconds && average >= scaler->budgetMilliseconds * RAISE_THRESHOLD)
+        return false;
+
+    f64 factor = sqrt(scaler->budgetMilliseconds * TARGET_FRACTION / average);
+    factor = (factor < MAX_DECREASE_FACTOR) ? MAX_DECREASE_FACTOR : factor;
+    factor = (factor > MAX_INCREASE_FACTOR) ? MAX_INCREASE_FACTOR : factor;
+
+    f32 scale = (f32)(scaler->scale * factor);
+    scale = (scale < scaler->minScale) ? scaler->minScale : scale;
+    scale = (scale > scaler->maxScale) ? scaler->maxScale : scale;
+
+    if (fabsf(scale - scaler->scale) < MIN_SCALE_CHANGE)
+        return false;
+
+    scaler->scale = scale;
+    scaler->sampleCount = 0;
+    scaler->settleFrameCount = SETTLE_FRAME_COUNT;
+    return true;
+}
+
+VkExtent2D getScaledExtent(const ResolutionScaler* scaler, VkExtent2D extent)
+{
+    VkExtent2D scaled = {
+        .width = (u32)(extent.width * scaler->scale + 0.5f),
+        .height = (u32)(extent.height * scaler->scale + 0.5f)
+    };
+
+    scaled.width = (scaled.width < 1) ? 1 : scaled.width;
+    scaled.height = (scaled.height < 1) ? 1 : scaled.height;
+    scaled.width = (scaled.width > extent.width) ? extent.width : scaled.width;
+    scaled.height = (scaled.height > extent.height) ? extent.height : scaled.height;
+    return scaled;
+}
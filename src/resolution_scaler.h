@@ -0,0 +1,33 @@
+#ifndef RESOLUTION_SCALER_H
+#define RESOLUTION_SCALER_H
+
+#include "util.h"
+
+#include <vulkan/vulkan.h>
+
+// Picks the fraction of the window resolution the scene is rendered at so
+// the measured GPU frame time stays within a budget. GPU time is assumed to
+// grow with the pixel count, i.e. with the square of the scale.
+typedef struct
+{
+    f64 budgetMilliseconds;
+    f32 minScale;
+    f32 maxScale;
+    f32 scale;
+
+    f64 averageMilliseconds;
+    u32 sampleCount;
+    // Timings arrive frames late, so after a change a few samples are still
+    // from the old scale and are skipped
+    u32 settleFrameCount;
+} ResolutionScaler;
+
+void createResolutionScaler(ResolutionScaler* scaler, f64 budgetMilliseconds, f32 minScale, f32 maxScale);
+
+// Feeds one GPU frame time and returns true when the scale changed
+bool updateResolutionScale(ResolutionScaler* scaler, f64 gpuFrameMilliseconds);
+
+// Scales extent, keeping both sides at least one pixel
+VkExtent2D getScaledExtent(const ResolutionScaler* scaler, VkExtent2D extent);
+
+#endif
@@ -0,0 +1,496 @@
+#include "texture_decode.h"
+
+static u8 clampToByte(i32 value)
+{
+    return (u8)((value < 0) ? 0 : (value > 255) ? 255 : value);
+}
+
+static void expandRGB565(u16 color, u8 outRGB[3])
+{
+    u8 r = (color >> 11) & 0x1F;
+    u8 g = (color >> 5) & 0x3F;
+    u8 b = color & 0x1F;
+    outRGB[0] = (r << 3) | (r >> 2);
+    outRGB[1] = (g << 2) | (g >> 4);
+    outRGB[2] = (b << 3) | (b >> 2);
+}
+
+void decodeBC1Block(const u8* block, bool punchThroughAlpha, u8 outTexels[64])
+{
+    u16 color0 = block[0] | (block[1] << 8);
+    u16 color1 = block[2] | (block[3] << 8);
+    u32 indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((u32)block[7] << 24);
+
+    u8 palette[4][4];
+    expandRGB565(color0, palette[0]);
+    expandRGB565(color1, palette[1]);
+    palette[0][3] = 255;
+    palette[1][3] = 255;
+
+    for (u32 c = 0; c < 3; c++)
+    {
+        if (color0 > color1)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[2][3] = 255;
+    palette[3][3] = (color0 <= color1 && punchThroughAlpha) ? 0 : 255;
+
+    for (u32 i = 0; i < 16; i++)
+        for (u32 c = 0; c < 4; c++)
+            outTexels[i * 4 + c] = palette[(indices >> (i * 2)) & 3][c];
+}
+
+typedef struct
+{
+    u8 subsetCount;
+    u8 partitionBits;
+    u8 rotationBits;
+    u8 indexSelectionBits;
+    u8 colorBits;
+    u8 alphaBits;
+    u8 endpointPBits;
+    u8 sharedPBits;
+    u8 indexBits;
+    u8 secondaryIndexBits;
+} BC7Mode;
+
+static const BC7Mode bc7Modes[8] = {
+    {3, 4, 0, 0, 4, 0, 1, 0, 3, 0},
+    {2, 6, 0, 0, 6, 0, 0, 1, 3, 0},
+    {3, 6, 0, 0, 5, 0, 0, 0, 2, 0},
+    {2, 6, 0, 0, 7, 0, 1, 0, 2, 0},
+    {1, 0, 2, 1, 5, 6, 0, 0, 2, 3},
+    {1, 0, 2, 0, 7, 8, 0, 0, 2, 2},
+    {1, 0, 0, 0, 7, 7, 1, 0, 4, 0},
+    {2, 6, 0, 0, 5, 5, 1, 0, 2, 0}
+};
+
+// Bit i is the subset of texel i
+static const u16 bc7Partitions2[64] = {
+    0xCCCC, 0x8888, 0xEEEE, 0xECC8, 0xC880, 0xFEEC, 0xFEC8, 0xEC80,
+    0xC800, 0xFFEC, 0xFE80, 0xE800, 0xFFE8, 0xFF00, 0xFFF0, 0xF000,
+    0xF710, 0x008E, 0x7100, 0x08CE, 0x008C, 0x7310, 0x3100, 0x8CCE,
+    0x088C, 0x3110, 0x6666, 0x366C, 0x17E8, 0x0FF0, 0x718E, 0x399C,
+    0xAAAA, 0xF0F0, 0x5A5A, 0x33CC, 0x3C3C, 0x55AA, 0x9696, 0xA55A,
+    0x73CE, 0x13C8, 0x324C, 0x3BDC, 0x6996, 0xC33C, 0x9966, 0x0660,
+    0x0272, 0x04E4, 0x4E40, 0x2720, 0xC936, 0x936C, 0x39C6, 0x639C,
+    0x9336, 0x9CC6, 0x817E, 0xE718, 0xCCF0, 0x0FCC, 0x7744, 0xEE22
+};
+
+static const u8 bc7Partitions3[64][16] = {
+    {0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 1, 2, 2, 2, 2}, {0, 0, 0, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 2, 1},
+    {0, 0, 0, 0, 2, 0, 0, 1, 2, 2, 1, 1, 2, 2, 1, 1}, {0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 1, 0, 1, 1, 1},
+    {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2}, {0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 2, 2},
+    {0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1}, {0, 0, 1, 1, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1},
+    {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2}, {0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 2, 2},
+    {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2}, {0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2},
+    {0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2, 0, 1, 1, 2}, {0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2, 0, 1, 2, 2},
+    {0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2, 1, 2, 2, 2}, {0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0, 2, 2, 2, 0},
+    {0, 0, 0, 1, 0, 0, 1, 1, 0, 1, 1, 2, 1, 1, 2, 2}, {0, 1, 1, 1, 0, 0, 1, 1, 2, 0, 0, 1, 2, 2, 0, 0},
+    {0, 0, 0, 0, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2}, {0, 0, 2, 2, 0, 0, 2, 2, 0, 0, 2, 2, 1, 1, 1, 1},
+    {0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2, 0, 2, 2, 2}, {0, 0, 0, 1, 0, 0, 0, 1, 2, 2, 2, 1, 2, 2, 2, 1},
+    {0, 0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2}, {0, 0, 0, 0, 1, 1, 0, 0, 2, 2, 1, 0, 2, 2, 1, 0},
+    {0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1, 0, 0, 0, 0}, {0, 0, 1, 2, 0, 0, 1, 2, 1, 1, 2, 2, 2, 2, 2, 2},
+    {0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1, 0, 1, 1, 0}, {0, 0, 0, 0, 0, 1, 1, 0, 1, 2, 2, 1, 1, 2, 2, 1},
+    {0, 0, 2, 2, 1, 1, 0, 2, 1, 1, 0, 2, 0, 0, 2, 2}, {0, 1, 1, 0, 0, 1, 1, 0, 2, 0, 0, 2, 2, 2, 2, 2},
+    {0, 0, 1, 1, 0, 1, 2, 2, 0, 1, 2, 2, 0, 0, 1, 1}, {0, 0, 0, 0, 2, 0, 0, 0, 2, 2, 1, 1, 2, 2, 2, 1},
+    {0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 2, 2, 2}, {0, 2, 2, 2, 0, 0, 2, 2, 0, 0, 1, 2, 0, 0, 1, 1},
+    {0, 0, 1, 1, 0, 0, 1, 2, 0, 0, 2, 2, 0, 2, 2, 2}, {0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0, 0, 1, 2, 0},
+    {0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0}, {0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0, 1, 2, 0},
+    {0, 1, 2, 0, 2, 0, 1, 2, 1, 2, 0, 1, 0, 1, 2, 0}, {0, 0, 1, 1, 2, 2, 0, 0, 1, 1, 2, 2, 0, 0, 1, 1},
+    {0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 0, 0, 0, 0, 1, 1}, {0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2},
+    {0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1}, {0, 0, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2, 1, 1, 2, 2},
+    {0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 2, 2, 0, 0, 1, 1}, {0, 2, 2, 0, 1, 2, 2, 1, 0, 2, 2, 0, 1, 2, 2, 1},
+    {0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 0, 1, 0, 1}, {0, 0, 0, 0, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1, 2, 1},
+    {0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 0, 1, 2, 2, 2, 2}, {0, 2, 2, 2, 0, 1, 1, 1, 0, 2, 2, 2, 0, 1, 1, 1},
+    {0, 0, 0, 2, 1, 1, 1, 2, 0, 0, 0, 2, 1, 1, 1, 2}, {0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2, 2, 1, 1, 2},
+    {0, 2, 2, 2, 0, 1, 1, 1, 0, 1, 1, 1, 0, 2, 2, 2}, {0, 0, 0, 2, 1, 1, 1, 2, 1, 1, 1, 2, 0, 0, 0, 2},
+    {0, 1, 1, 0, 0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2}, {0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2, 2, 1, 1, 2},
+    {0, 1, 1, 0, 0, 1, 1, 0, 2, 2, 2, 2, 2, 2, 2, 2}, {0, 0, 2, 2, 0, 0, 1, 1, 0, 0, 1, 1, 0, 0, 2, 2},
+    {0, 0, 2, 2, 1, 1, 2, 2, 1, 1, 2, 2, 0, 0, 2, 2}, {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 2, 1, 1, 2},
+    {0, 0, 0, 2, 0, 0, 0, 1, 0, 0, 0, 2, 0, 0, 0, 1}, {0, 2, 2, 2, 1, 2, 2, 2, 0, 2, 2, 2, 1, 2, 2, 2},
+    {0, 1, 0, 1, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2}, {0, 1, 1, 1, 2, 0, 1, 1, 2, 2, 0, 1, 2, 2, 2, 0}
+};
+
+// Texels whose index is stored with one bit less, the first texel of
+// subset 0 is always texel 0
+static const u8 bc7Anchors2[64] = {
+    15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+    15,  2,  8,  2,  2,  8,  8, 15,  2,  8,  2,  2,  8,  8,  2,  2,
+    15, 15,  6,  8,  2,  8, 15, 15,  2,  8,  2,  2,  2, 15, 15,  6,
+     6,  2,  6,  8, 15, 15,  2,  2, 15, 15, 15, 15, 15,  2,  2, 15
+};
+
+static const u8 bc7Anchors3Second[64] = {
+     3,  3, 15, 15,  8,  3, 15, 15,  8,  8,  6,  6,  6,  5,  3,  3,
+     3,  3,  8, 15,  3,  3,  6, 10,  5,  8,  8,  6,  8,  5, 15, 15,
+     8, 15,  3,  5,  6, 10,  8, 15, 15,  3, 15,  5, 15, 15, 15, 15,
+     3, 15,  5,  5,  5,  8,  5, 10,  5, 10,  8, 13, 15, 12,  3,  3
+};
+
+static const u8 bc7Anchors3Third[64] = {
+    15,  8,  8,  3, 15, 15,  3,  8, 15, 15, 15, 15, 15, 15, 15,  8,
+    15,  8, 15,  3, 15,  8, 15,  8,  3, 15,  6, 10, 15, 15, 10,  8,
+    15,  3, 15, 10, 10,  8,  9, 10,  6, 15,  8, 15,  3,  6,  6,  8,
+    15,  3, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,  3, 15, 15,  8
+};
+
+static const u8 bc7Weights2[4] = {0, 21, 43, 64};
+static const u8 bc7Weights3[8] = {0, 9, 18, 27, 37, 46, 55, 64};
+static const u8 bc7Weights4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+typedef struct
+{
+    const u8* data;
+    u32 position;
+} BitReader;
+
+static u32 readBits(BitReader* reader, u32 count)
+{
+    u32 value = 0;
+    for (u32 i = 0; i < count; i++, reader->position++)
+        value |= (u32)((reader->data[reader->position >> 3] >> (reader->position & 7)) & 1) << i;
+    return value;
+}
+
+static u8 getBC7Subset(const BC7Mode* mode, u32 partition, u32 texel)
+{
+    if (mode->subsetCount == 2)
+        return (bc7Partitions2[partition] >> texel) & 1;
+    if (mode->subsetCount == 3)
+        return bc7Partitions3[partition][texel];
+    return 0;
+}
+
+static bool isBC7Anchor(const BC7Mode* mode, u32 partition, u32 texel)
+{
+    if (texel == 0)
+        return true;
+    if (mode->subsetCount == 2)
+        return texel == bc7Anchors2[partition];
+    if (mode->subsetCount == 3)
+        return texel == bc7Anchors3Second[partition] || texel == bc7Anchors3Third[partition];
+    return false;
+}
+
+static u8 interpolateBC7(u8 e0, u8 e1, u32 index, u32 indexBits)
+{
+    const u8* weights = (indexBits == 2) ? bc7Weights2 : (indexBits == 3) ? bc7Weights3 : bc7Weights4;
+    return (u8)(((64 - weights[index]) * e0 + weights[index] * e1 + 32) >> 6);
+}
+
+void decodeBC7Block(const u8* block, u8 outTexels[64])
+{
+    u32 modeIndex = 0;
+    while (modeIndex < 8 && !(block[0] & (1 << modeIndex)))
+        modeIndex++;
+
+    // Reserved mode, decodes to transparent black
+    if (modeIndex == 8)
+    {
+        for (u32 i = 0; i < 64; i++)
+            outTexels[i] = 0;
+        return;
+    }
+
+    const BC7Mode* mode = &bc7Modes[modeIndex];
+    BitReader reader = {.data = block, .position = modeIndex + 1};
+
+    u32 partition = readBits(&reader, mode->partitionBits);
+    u32 rotation = readBits(&reader, mode->rotationBits);
+    u32 indexSelection = readBits(&reader, mode->indexSelectionBits);
+
+    // endpoints[subset * 2 + endpoint][component]
+    u8 endpoints[6][4];
+    u32 endpointCount = mode->subsetCount * 2;
+    for (u32 c = 0; c < 3; c++)
+        for (u32 e = 0; e < endpointCount; e++)
+            endpoints[e][c] = readBits(&reader, mode->colorBits);
+    for (u32 e = 0; e < endpointCount; e++)
+        endpoints[e][3] = (mode->alphaBits > 0) ? readBits(&reader, mode->alphaBits) : 255;
+
+    u32 colorPrecision = mode->colorBits;
+    u32 alphaPrecision = mode->alphaBits;
+    if (mode->endpointPBits || mode->sharedPBits)
+    {
+        u8 pBits[6];
+        if (mode->endpointPBits)
+        {
+            for (u32 e = 0; e < endpointCount; e++)
+                pBits[e] = readBits(&reader, 1);
+        }
+        else
+        {
+            for (u32 s = 0; s < mode->subsetCount; s++)
+                pBits[s * 2] = pBits[s * 2 + 1] = readBits(&reader, 1);
+        }
+
+        for (u32 e = 0; e < endpointCount; e++)
+            for (u32 c = 0; c < 4; c++)
+                if (c < 3 || mode->alphaBits > 0)
+                    endpoints[e][c] = (endpoints[e][c] << 1) | pBits[e];
+
+        colorPrecision++;
+        alphaPrecision += (mode->alphaBits > 0) ? 1 : 0;
+    }
+
+    // Expand to 8 bits by replicating the high bits into the low ones
+    for (u32 e = 0; e < endpointCount; e++)
+    {
+        for (u32 c = 0; c < 3; c++)
+            endpoints[e][c] = (u8)((endpoints[e][c] << (8 - colorPrecision)) | (endpoints[e][c] >> (2 * colorPrecision - 8)));
+        if (mode->alphaBits > 0)
+            endpoints[e][3] = (u8)((endpoints[e][3] << (8 - alphaPrecision)) | (endpoints[e][3] >> (2 * alphaPrecision - 8)));
+    }
+
+    u8 indices[16];
+    for (u32 i = 0; i < 16; i++)
+        indices[i] = readBits(&reader, mode->indexBits - (isBC7Anchor(mode, partition, i) ? 1 : 0));
+
+    u8 secondaryIndices[16] = {0};
+    if (mode->secondaryIndexBits > 0)
+        for (u32 i = 0; i < 16; i++)
+            secondaryIndices[i] = readBits(&reader, mode->secondaryIndexBits - ((i == 0) ? 1 : 0));
+    ASSERT(reader.position == 128);
+
+    for (u32 i = 0; i < 16; i++)
+    {
+        u32 subset = getBC7Subset(mode, partition, i);
+        const u8* e0 = endpoints[subset * 2];
+        const u8* e1 = endpoints[subset * 2 + 1];
+        u8* texel = &outTexels[i * 4];
+
+        if (mode->secondaryIndexBits > 0)
+        {
+            // Mode 4 can swap which index set drives color and alpha
+            bool swap = indexSelection != 0;
+            u32 colorIndex = swap ? secondaryIndices[i] : indices[i];
+            u32 colorIndexBits = swap ? mode->secondaryIndexBits : mode->indexBits;
+            u32 alphaIndex = swap ? indices[i] : secondaryIndices[i];
+            u32 alphaIndexBits = swap ? mode->indexBits : mode->secondaryIndexBits;
+
+            for (u32 c = 0; c < 3; c++)
+                texel[c] = interpolateBC7(e0[c], e1[c], colorIndex, colorIndexBits);
+            texel[3] = interpolateBC7(e0[3], e1[3], alphaIndex, alphaIndexBits);
+        }
+        else
+        {
+            for (u32 c = 0; c < 4; c++)
+                texel[c] = interpolateBC7(e0[c], e1[c], indices[i], mode->indexBits);
+        }
+
+        if (rotation > 0)
+        {
+            u8 swapped = texel[rotation - 1];
+            texel[rotation - 1] = texel[3];
+            texel[3] = swapped;
+        }
+    }
+}
+
+static const u8 etcModifierTable[8][2] = {
+    {2, 8}, {5, 17}, {9, 29}, {13, 42}, {18, 60}, {24, 80}, {33, 106}, {47, 183}
+};
+
+static const u8 etcDistanceTable[8] = {3, 6, 11, 16, 23, 32, 41, 64};
+
+static u8 extend4(u32 value) { return (u8)((value << 4) | value); }
+static u8 extend5(u32 value) { return (u8)((value << 3) | (value >> 2)); }
+static u8 extend6(u32 value) { return (u8)((value << 2) | (value >> 4)); }
+static u8 extend7(u32 value) { return (u8)((value << 1) | (value >> 6)); }
+
+static i32 signExtend3(u32 value)
+{
+    return (value & 4) ? (i32)value - 8 : (i32)value;
+}
+
+static u64 readBigEndian64(const u8* data)
+{
+    u64 value = 0;
+    for (u32 i = 0; i < 8; i++)
+        value = (value << 8) | data[i];
+    return value;
+}
+
+// Texel indices run down the columns, texel (x, y) is at bit x * 4 + y
+static u32 getETCTexelIndex(u64 bits, u32 x, u32 y)
+{
+    u32 bit = x * 4 + y;
+    return (u32)((((bits >> (bit + 16)) & 1) << 1) | ((bits >> bit) & 1));
+}
+
+static void writeETCPaintColors(u64 bits, const u8 paintColors[4][3], u8 outTexels[64])
+{
+    for (u32 y = 0; y < 4; y++)
+        for (u32 x = 0; x < 4; x++)
+            for (u32 c = 0; c < 3; c++)
+                outTexels[(y * 4 + x) * 4 + c] = paintColors[getETCTexelIndex(bits, x, y)][c];
+}
+
+void decodeETC2RGBBlock(const u8* block, u8 outTexels[64])
+{
+    u64 bits = readBigEndian64(block);
+
+    for (u32 i = 0; i < 16; i++)
+        outTexels[i * 4 + 3] = 255;
+
+    u8 baseColors[2][3];
+    bool differential = (bits >> 33) & 1;
+
+    if (differential)
+    {
+        i32 r = (bits >> 59) & 0x1F;
+        i32 g = (bits >> 51) & 0x1F;
+        i32 b = (bits >> 43) & 0x1F;
+        i32 dr = signExtend3((bits >> 56) & 7);
+        i32 dg = signExtend3((bits >> 48) & 7);
+        i32 db = signExtend3((bits >> 40) & 7);
+
+        if (r + dr < 0 || r + dr > 31)
+        {
+            // T mode
+            u8 color0[3] = {
+                extend4((u32)(((bits >> 59) & 3) << 2 | ((bits >> 56) & 3))),
+                extend4((bits >> 52) & 0xF),
+                extend4((bits >> 48) & 0xF)
+            };
+            u8 color1[3] = {extend4((bits >> 44) & 0xF), extend4((bits >> 40) & 0xF), extend4((bits >> 36) & 0xF)};
+            i32 distance = etcDistanceTable[((bits >> 34) & 3) << 1 | ((bits >> 32) & 1)];
+
+            u8 paintColors[4][3];
+            for (u32 c = 0; c < 3; c++)
+            {
+                paintColors[0][c] = color0[c];
+                paintColors[1][c] = clampToByte(color1[c] + distance);
+                paintColors[2][c] = color1[c];
+                paintColors[3][c] = clampToByte(color1[c] - distance);
+            }
+            writeETCPaintColors(bits, paintColors, outTexels);
+            return;
+        }
+
+        if (g + dg < 0 || g + dg > 31)
+        {
+            // H mode
+            u32 r0 = (bits >> 59) & 0xF;
+            u32 g0 = ((bits >> 56) & 7) << 1 | ((bits >> 52) & 1);
+            u32 b0 = ((bits >> 51) & 1) << 3 | ((bits >> 47) & 7);
+            u32 r1 = (bits >> 43) & 0xF;
+            u32 g1 = (bits >> 39) & 0xF;
+            u32 b1 = (bits >> 35) & 0xF;
+            u32 distanceIndex = ((bits >> 34) & 1) << 2 | ((bits >> 32) & 1) << 1;
+            distanceIndex |= ((r0 << 8 | g0 << 4 | b0) >= (r1 << 8 | g1 << 4 | b1)) ? 1 : 0;
+            i32 distance = etcDistanceTable[distanceIndex];
+
+            u8 color0[3] = {extend4(r0), extend4(g0), extend4(b0)};
+            u8 color1[3] = {extend4(r1), extend4(g1), extend4(b1)};
+            u8 paintColors[4][3];
+            for (u32 c = 0; c < 3; c++)
+            {
+                paintColors[0][c] = clampToByte(color0[c] + distance);
+                paintColors[1][c] = clampToByte(color0[c] - distance);
+                paintColors[2][c] = clampToByte(color1[c] + distance);
+                paintColors[3][c] = clampToByte(color1[c] - distance);
+            }
+            writeETCPaintColors(bits, paintColors, outTexels);
+            return;
+        }
+
+        if (b + db < 0 || b + db > 31)
+        {
+            // Planar mode, colors are interpolated from an origin plus
+            // horizontal and vertical gradients
+            i32 origin[3] = {
+                extend6((bits >> 57) & 0x3F),
+                extend7((u32)(((bits >> 56) & 1) << 6 | ((bits >> 49) & 0x3F))),
+                extend6((u32)(((bits >> 48) & 1) << 5 | ((bits >> 43) & 3) << 3 | ((bits >> 39) & 7)))
+            };
+            i32 horizontal[3] = {
+                extend6((u32)(((bits >> 34) & 0x1F) << 1 | ((bits >> 32) & 1))),
+                extend7((bits >> 25) & 0x7F),
+                extend6((bits >> 19) & 0x3F)
+            };
+            i32 vertical[3] = {
+                extend6((bits >> 13) & 0x3F),
+                extend7((bits >> 6) & 0x7F),
+                extend6(bits & 0x3F)
+            };
+
+            for (i32 y = 0; y < 4; y++)
+                for (i32 x = 0; x < 4; x++)
+                    for (u32 c = 0; c < 3; c++)
+                        outTexels[(y * 4 + x) * 4 + c] = clampToByte((x * (horizontal[c] - origin[c]) + y * (vertical[c] - origin[c]) + 4 * origin[c] + 2) >> 2);
+            return;
+        }
+
+        baseColors[0][0] = extend5(r);
+        baseColors[0][1] = extend5(g);
+        baseColors[0][2] = extend5(b);
+        baseColors[1][0] = extend5(r + dr);
+        baseColors[1][1] = extend5(g + dg);
+        baseColors[1][2] = extend5(b + db);
+    }
+    else
+    {
+        baseColors[0][0] = extend4((bits >> 60) & 0xF);
+        baseColors[0][1] = extend4((bits >> 52) & 0xF);
+        baseColors[0][2] = extend4((bits >> 44) & 0xF);
+        baseColors[1][0] = extend4((bits >> 56) & 0xF);
+        baseColors[1][1] = extend4((bits >> 48) & 0xF);
+        baseColors[1][2] = extend4((bits >> 40) & 0xF);
+    }
+
+    u32 tables[2] = {(bits >> 37) & 7, (bits >> 34) & 7};
+    bool flip = (bits >> 32) & 1;
+
+    for (u32 y = 0; y < 4; y++)
+    {
+        for (u32 x = 0; x < 4; x++)
+        {
+            u32 subblock = flip ? (y >= 2) : (x >= 2);
+            u32 index = getETCTexelIndex(bits, x, y);
+            i32 modifier = etcModifierTable[tables[subblock]][index & 1];
+            modifier = (index & 2) ? -modifier : modifier;
+
+            for (u32 c = 0; c < 3; c++)
+                outTexels[(y * 4 + x) * 4 + c] = clampToByte(baseColors[subblock][c] + modifier);
+        }
+    }
+}
+
+static const i8 eacModifierTable[16][8] = {
+    {-3, -6, -9, -15, 2, 5, 8, 14}, {-3, -7, -10, -13, 2, 6, 9, 12},
+    {-2, -5, -8, -13, 1, 4, 7, 12}, {-2, -4, -6, -13, 1, 3, 5, 12},
+    {-3, -6, -8, -12, 2, 5, 7, 11}, {-3, -7, -9, -11, 2, 6, 8, 10},
+    {-4, -7, -8, -11, 3, 6, 7, 10}, {-3, -5, -8, -11, 2, 4, 7, 10},
+    {-2, -6, -8, -10, 1, 5, 7, 9}, {-2, -5, -8, -10, 1, 4, 7, 9},
+    {-2, -4, -8, -10, 1, 3, 7, 9}, {-2, -5, -7, -10, 1, 4, 6, 9},
+    {-3, -4, -7, -10, 2, 3, 6, 9}, {-1, -2, -3, -10, 0, 1, 2, 9},
+    {-4, -6, -8, -9, 3, 5, 7, 8}, {-3, -5, -7, -9, 2, 4, 6, 8}
+};
+
+void decodeEACAlphaBlock(const u8* block, u8 outTexels[64])
+{
+    u64 bits = readBigEndian64(block);
+    i32 base = (bits >> 56) & 0xFF;
+    i32 multiplier = (bits >> 52) & 0xF;
+    const i8* modifiers = eacModifierTable[(bits >> 48) & 0xF];
+
+    // 3-bit indices, first texel in the highest bits, running down the columns
+    for (u32 x = 0; x < 4; x++)
+    {
+        for (u32 y = 0; y < 4; y++)
+        {
+            u32 index = (bits >> (45 - (x * 4 + y) * 3)) & 7;
+            outTexels[(y * 4 + x) * 4 + 3] = clampToByte(base + modifiers[index] * multiplier);
+        }
+    }
+}
@@ -0,0 +1,19 @@
+#ifndef TEXTURE_DECODE_H
+#define TEXTURE_DECODE_H
+
+#include "util.h"
+
+// Block decoders for the compressed formats scop can load. Each decodes one
+// 4x4 block into 16 RGBA8 texels in row-major order. Values are returned as
+// stored, sRGB formats are not converted to linear.
+
+void decodeBC1Block(const u8* block, bool punchThroughAlpha, u8 outTexels[64]);
+void decodeBC7Block(const u8* block, u8 outTexels[64]);
+
+// Decodes the 8-byte ETC2 RGB part, leaving alpha at 255
+void decodeETC2RGBBlock(const u8* block, u8 outTexels[64]);
+
+// Decodes an 8-byte EAC block into the alpha channel of outTexels only
+void decodeEACAlphaBlock(const u8* block, u8 outTexels[64]);
+
+#endif
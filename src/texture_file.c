@@ -0,0 +1,498 @@
+#include "texture_file.h"
+#include "texture_decode.h"
+
+#include <math.h>
+#include <string.h>
+
+#define DDS_MAGIC 0x20534444 // "DDS "
+#define DDS_HEADER_SIZE 124
+#define DDS_DX10_HEADER_SIZE 20
+#define DDS_MIPMAP_COUNT 0x20000
+#define DDS_PIXEL_FORMAT_FOURCC 0x4
+#define DDS_PIXEL_FORMAT_RGB 0x40
+#define DDS_FOURCC(a, b, c, d) ((u32)(a) | ((u32)(b) << 8) | ((u32)(c) << 16) | ((u32)(d) << 24))
+
+#define DXGI_FORMAT_R8G8B8A8_UNORM 28
+#define DXGI_FORMAT_R8G8B8A8_UNORM_SRGB 29
+#define DXGI_FORMAT_BC1_UNORM 71
+#define DXGI_FORMAT_BC1_UNORM_SRGB 72
+#define DXGI_FORMAT_BC7_UNORM 98
+#define DXGI_FORMAT_BC7_UNORM_SRGB 99
+
+#define KTX2_HEADER_SIZE 80
+#define KTX2_LEVEL_INDEX_ENTRY_SIZE 24
+
+static const u8 ktx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+static u32 readU32(const u8* data)
+{
+    return data[0] | (data[1] << 8) | (data[2] << 16) | ((u32)data[3] << 24);
+}
+
+static u64 readU64(const u8* data)
+{
+    return readU32(data) | ((u64)readU32(data + 4) << 32);
+}
+
+static u8* readFile(const char* filename, usize* outSize)
+{
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL)
+        PANIC("%s%s\n", "Failed to open file: ", filename);
+
+    if (fseek(file, 0, SEEK_END) != 0)
+        PANIC("%s%s\n", "Failed to seek file: ", filename);
+    long size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0)
+        PANIC("%s%s\n", "Failed to determine size of file: ", filename);
+
+    u8* data = mallocOrDie(size > 0 ? (usize)size : 1);
+    if (fread(data, 1, (usize)size, file) != (usize)size)
+        PANIC("%s%s\n", "Failed to read file: ", filename);
+
+    fclose(file);
+
+    *outSize = (usize)size;
+    return data;
+}
+
+static bool isSupportedFormat(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool isSrgbFormat(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool isCompressedTextureFormat(VkFormat format)
+{
+    return format != VK_FORMAT_R8G8B8A8_UNORM && format != VK_FORMAT_R8G8B8A8_SRGB;
+}
+
+static usize getBlockSize(VkFormat format)
+{
+    switch (format)
+    {
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            return 16;
+        default:
+            return 8;
+    }
+}
+
+usize getTextureLevelSize(VkFormat format, u32 width, u32 height)
+{
+    if (!isCompressedTextureFormat(format))
+        return (usize)width * height * 4;
+
+    return (usize)((width + 3) / 4) * ((height + 3) / 4) * getBlockSize(format);
+}
+
+static u32 getLevelExtent(u32 extent, u32 level)
+{
+    return (extent >> level > 0) ? extent >> level : 1;
+}
+
+u32 getFullMipLevelCount(u32 width, u32 height)
+{
+    u32 mipLevelCount = 1;
+    for (u32 size = (width > height) ? width : height; size > 1 && mipLevelCount < TEXTURE_MAX_MIP_LEVELS; size /= 2)
+        mipLevelCount++;
+    return mipLevelCount;
+}
+
+// Also keeps the level count within what Vulkan allows for the extent
+static bool isTextureExtentValid(u32 width, u32 height, u32 levelCount)
+{
+    return width > 0 && height > 0 && width <= TEXTURE_MAX_EXTENT && height <= TEXTURE_MAX_EXTENT
+        && levelCount <= getFullMipLevelCount(width, height);
+}
+
+// Copies levels out of the file into a tightly packed buffer so uploads do
+// not depend on the container's padding
+static void packTextureLevels(Texture* texture, const u8* fileData, usize fileSize, const usize* fileLevelOffsets, const char* filename)
+{
+    texture->dataSize = 0;
+    for (u32 i = 0; i < texture->mipLevelCount; i++)
+    {
+        texture->levelOffsets[i] = texture->dataSize;
+        texture->dataSize += getTextureLevelSize(texture->format, getLevelExtent(texture->width, i), getLevelExtent(texture->height, i));
+    }
+
+    texture->data = mallocOrDie(texture->dataSize);
+    for (u32 i = 0; i < texture->mipLevelCount; i++)
+    {
+        usize levelSize = getTextureLevelSize(texture->format, getLevelExtent(texture->width, i), getLevelExtent(texture->height, i));
+        if (fileLevelOffsets[i] > fileSize || levelSize > fileSize - fileLevelOffsets[i])
+            PANIC("%s%s\n", "Truncated texture file: ", filename);
+        memcpy(texture->data + texture->levelOffsets[i], fileData + fileLevelOffsets[i], levelSize);
+    }
+}
+
+static void parseKTX2(const u8* data, usize size, const char* filename, Texture* outTexture)
+{
+    if (size < KTX2_HEADER_SIZE)
+        PANIC("%s%s\n", "Truncated KTX2 header: ", filename);
+
+    VkFormat format = (VkFormat)readU32(data + 12);
+    u32 width = readU32(data + 20);
+    u32 height = readU32(data + 24);
+    u32 depth = readU32(data + 28);
+    u32 layerCount = readU32(data + 32);
+    u32 faceCount = readU32(data + 36);
+    u32 levelCount = readU32(data + 40);
+    u32 supercompressionScheme = readU32(data + 44);
+
+    if (!isSupportedFormat(format))
+        PANIC("%s%s\n", "Unsupported KTX2 texture format: ", filename);
+    if (depth > 1 || layerCount > 1 || faceCount != 1 || supercompressionScheme != 0)
+        PANIC("%s%s\n", "Only uncompressed single layer 2D KTX2 textures are supported: ", filename);
+
+    // A level count of 0 asks the loader to generate mipmaps
+    levelCount = (levelCount > 0) ? levelCount : 1;
+    if (!isTextureExtentValid(width, height, levelCount))
+        PANIC("%s%s\n", "Invalid KTX2 texture dimensions: ", filename);
+    if (size < KTX2_HEADER_SIZE + (usize)levelCount * KTX2_LEVEL_INDEX_ENTRY_SIZE)
+        PANIC("%s%s\n", "Truncated KTX2 level index: ", filename);
+
+    usize levelOffsets[TEXTURE_MAX_MIP_LEVELS];
+    for (u32 i = 0; i < levelCount; i++)
+    {
+        const u8* entry = data + KTX2_HEADER_SIZE + i * KTX2_LEVEL_INDEX_ENTRY_SIZE;
+        u64 byteOffset = readU64(entry);
+        u64 byteLength = readU64(entry + 8);
+        if (byteLength != getTextureLevelSize(format, getLevelExtent(width, i), getLevelExtent(height, i)))
+            PANIC("%s%s\n", "Unexpected KTX2 level size: ", filename);
+        levelOffsets[i] = (usize)byteOffset;
+    }
+
+    *outTexture = (Texture){
+        .format = format,
+        .width = width,
+        .height = height,
+        .mipLevelCount = levelCount
+    };
+    packTextureLevels(outTexture, data, size, levelOffsets, filename);
+}
+
+static VkFormat getDDSFormat(const u8* pixelFormat, const u8* dx10Header)
+{
+    u32 flags = readU32(pixelFormat + 4);
+    u32 fourCC = readU32(pixelFormat + 8);
+
+    if (dx10Header != NULL)
+    {
+        switch (readU32(dx10Header))
+        {
+            case DXGI_FORMAT_R8G8B8A8_UNORM: return VK_FORMAT_R8G8B8A8_UNORM;
+            case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB: return VK_FORMAT_R8G8B8A8_SRGB;
+            case DXGI_FORMAT_BC1_UNORM: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+            case DXGI_FORMAT_BC1_UNORM_SRGB: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+            case DXGI_FORMAT_BC7_UNORM: return VK_FORMAT_BC7_UNORM_BLOCK;
+            case DXGI_FORMAT_BC7_UNORM_SRGB: return VK_FORMAT_BC7_SRGB_BLOCK;
+            default: return VK_FORMAT_UNDEFINED;
+        }
+    }
+
+    if ((flags & DDS_PIXEL_FORMAT_FOURCC) && fourCC == DDS_FOURCC('D', 'X', 'T', '1'))
+        return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+
+    // Legacy uncompressed layout with the channels in R, G, B, A byte order
+    if ((flags & DDS_PIXEL_FORMAT_RGB) && readU32(pixelFormat + 12) == 32
+        && readU32(pixelFormat + 16) == 0x000000FF && readU32(pixelFormat + 20) == 0x0000FF00
+        && readU32(pixelFormat + 24) == 0x00FF0000)
+        return VK_FORMAT_R8G8B8A8_UNORM;
+
+    return VK_FORMAT_UNDEFINED;
+}
+
+static void parseDDS(const u8* data, usize size, const char* filename, Texture* outTexture)
+{
+    if (size < 4 + DDS_HEADER_SIZE || readU32(data + 4) != DDS_HEADER_SIZE)
+        PANIC("%s%s\n", "Truncated DDS header: ", filename);
+
+    const u8* header = data + 4;
+    u32 flags = readU32(header + 4);
+    u32 height = readU32(header + 8);
+    u32 width = readU32(header + 12);
+    // The count is only meaningful when its flag is set
+    u32 levelCount = (flags & DDS_MIPMAP_COUNT) ? readU32(header + 24) : 1;
+    const u8* pixelFormat = header + 72;
+
+    usize dataOffset = 4 + DDS_HEADER_SIZE;
+    const u8* dx10Header = NULL;
+    if ((readU32(pixelFormat + 4) & DDS_PIXEL_FORMAT_FOURCC) && readU32(pixelFormat + 8) == DDS_FOURCC('D', 'X', '1', '0'))
+    {
+        if (size < dataOffset + DDS_DX10_HEADER_SIZE)
+            PANIC("%s%s\n", "Truncated DDS DX10 header: ", filename);
+        dx10Header = data + dataOffset;
+        dataOffset += DDS_DX10_HEADER_SIZE;
+
+        // Resource dimension 3 is a 2D texture
+        if (readU32(dx10Header + 4) != 3 || readU32(dx10Header + 12) > 1)
+            PANIC("%s%s\n", "Only single layer 2D DDS textures are supported: ", filename);
+    }
+
+    VkFormat format = getDDSFormat(pixelFormat, dx10Header);
+    if (format == VK_FORMAT_UNDEFINED)
+        PANIC("%s%s\n", "Unsupported DDS texture format: ", filename);
+
+    levelCount = (levelCount > 0) ? levelCount : 1;
+    if (!isTextureExtentValid(width, height, levelCount))
+        PANIC("%s%s\n", "Invalid DDS texture dimensions: ", filename);
+
+    // DDS stores the levels back to back without padding
+    usize levelOffsets[TEXTURE_MAX_MIP_LEVELS];
+    for (u32 i = 0; i < levelCount; i++)
+    {
+        levelOffsets[i] = dataOffset;
+        dataOffset += getTextureLevelSize(format, getLevelExtent(width, i), getLevelExtent(height, i));
+    }
+
+    *outTexture = (Texture){
+        .format = format,
+        .width = width,
+        .height = height,
+        .mipLevelCount = levelCount
+    };
+    packTextureLevels(outTexture, data, size, levelOffsets, filename);
+}
+
+void loadTextureFile(const char* filename, Texture* outTexture)
+{
+    ASSERT(outTexture != NULL);
+
+    usize size;
+    u8* data = readFile(filename, &size);
+
+    if (size >= sizeof(ktx2Identifier) && memcmp(data, ktx2Identifier, sizeof(ktx2Identifier)) == 0)
+        parseKTX2(data, size, filename, outTexture);
+    else if (size >= 4 && readU32(data) == DDS_MAGIC)
+        parseDDS(data, size, filename, outTexture);
+    else
+        PANIC("%s%s\n", "Texture file is neither KTX2 nor DDS: ", filename);
+
+    freeAndNull(data);
+}
+
+void createRGBA8Texture(u8* pixels, u32 width, u32 height, bool srgb, Texture* outTexture)
+{
+    *outTexture = (Texture){
+        .format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM,
+        .width = width,
+        .height = height,
+        .mipLevelCount = 1,
+        .data = pixels,
+        .dataSize = (usize)width * height * 4
+    };
+}
+
+void freeTexture(Texture* texture)
+{
+    freeAndNull(texture->data);
+    texture->dataSize = 0;
+}
+
+static void decodeBlock(VkFormat format, const u8* block, u8 outTexels[64])
+{
+    switch (format)
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            decodeBC1Block(block, false, outTexels);
+            break;
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            decodeBC1Block(block, true, outTexels);
+            break;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            decodeBC7Block(block, outTexels);
+            break;
+        case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+            decodeETC2RGBBlock(block, outTexels);
+            break;
+        case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+        case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+            // The EAC alpha block comes first
+            decodeETC2RGBBlock(block + 8, outTexels);
+            decodeEACAlphaBlock(block, outTexels);
+            break;
+        default:
+            PANIC("%s\n", "Unsupported compressed texture format");
+    }
+}
+
+void decodeTexture(const Texture* texture, Texture* outTexture)
+{
+    ASSERT(isCompressedTextureFormat(texture->format));
+
+    bool srgb = isSrgbFormat(texture->format);
+    *outTexture = (Texture){
+        .format = srgb ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM,
+        .width = texture->width,
+        .height = texture->height,
+        .mipLevelCount = texture->mipLevelCount
+    };
+
+    for (u32 i = 0; i < texture->mipLevelCount; i++)
+    {
+        outTexture->levelOffsets[i] = outTexture->dataSize;
+        outTexture->dataSize += getTextureLevelSize(outTexture->format, getLevelExtent(texture->width, i), getLevelExtent(texture->height, i));
+    }
+    outTexture->data = mallocOrDie(outTexture->dataSize);
+
+    usize blockSize = getBlockSize(texture->format);
+    for (u32 level = 0; level < texture->mipLevelCount; level++)
+    {
+        u32 width = getLevelExtent(texture->width, level);
+        u32 height = getLevelExtent(texture->height, level);
+        u32 blocksX = (width + 3) / 4;
+        u32 blocksY = (height + 3) / 4;
+        const u8* src = texture->data + texture->levelOffsets[level];
+        u8* dst = outTexture->data + outTexture->levelOffsets[level];
+
+        for (u32 by = 0; by < blocksY; by++)
+        {
+            for (u32 bx = 0; bx < blocksX; bx++)
+            {
+                u8 texels[64];
+                decodeBlock(texture->format, src + ((usize)by * blocksX + bx) * blockSize, texels);
+
+                // Blocks hanging over the edge of small levels are clipped
+                for (u32 y = 0; y < 4 && by * 4 + y < height; y++)
+                    for (u32 x = 0; x < 4 && bx * 4 + x < width; x++)
+                        memcpy(&dst[(((usize)by * 4 + y) * width + bx * 4 + x) * 4], &texels[(y * 4 + x) * 4], 4);
+            }
+        }
+    }
+}
+
+static f32 srgbToLinear(u8 value)
+{
+    f32 c = value / 255.0f;
+    return (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static u8 linearToSrgb(f32 value)
+{
+    f32 c = (value <= 0.0031308f) ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+    return (u8)(c * 255.0f + 0.5f);
+}
+
+void generateTextureMipChain(const Texture* texture, Texture* outTexture)
+{
+    ASSERT(!isCompressedTextureFormat(texture->format));
+
+    u32 mipLevelCount = getFullMipLevelCount(texture->width, texture->height);
+
+    *outTexture = (Texture){
+        .format = texture->format,
+        .width = texture->width,
+        .height = texture->height,
+        .mipLevelCount = mipLevelCount
+    };
+
+    for (u32 i = 0; i < mipLevelCount; i++)
+    {
+        outTexture->levelOffsets[i] = outTexture->dataSize;
+        outTexture->dataSize += getTextureLevelSize(texture->format, getLevelExtent(texture->width, i), getLevelExtent(texture->height, i));
+    }
+
+    outTexture->data = mallocOrDie(outTexture->dataSize);
+    memcpy(outTexture->data, texture->data, getTextureLevelSize(texture->format, texture->width, texture->height));
+
+    bool srgb = isSrgbFormat(texture->format);
+    f32 toLinear[256];
+    for (u32 i = 0; i < 256; i++)
+        toLinear[i] = srgb ? srgbToLinear((u8)i) : i / 255.0f;
+
+    for (u32 level = 1; level < mipLevelCount; level++)
+    {
+        u32 srcWidth = getLevelExtent(texture->width, level - 1);
+        u32 srcHeight = getLevelExtent(texture->height, level - 1);
+        u32 dstWidth = getLevelExtent(texture->width, level);
+        u32 dstHeight = getLevelExtent(texture->height, level);
+        const u8* src = outTexture->data + outTexture->levelOffsets[level - 1];
+        u8* dst = outTexture->data + outTexture->levelOffsets[level];
+
+        for (u32 y = 0; y < dstHeight; y++)
+        {
+            for (u32 x = 0; x < dstWidth; x++)
+            {
+                u32 x0 = (x * 2 < srcWidth) ? x * 2 : srcWidth - 1;
+                u32 y0 = (y * 2 < srcHeight) ? y * 2 : srcHeight - 1;
+                u32 x1 = (x0 + 1 < srcWidth) ? x0 + 1 : x0;
+                u32 y1 = (y0 + 1 < srcHeight) ? y0 + 1 : y0;
+                const u8* texels[4] = {
+                    &src[(y0 * srcWidth + x0) * 4],
+                    &src[(y0 * srcWidth + x1) * 4],
+                    &src[(y1 * srcWidth + x0) * 4],
+                    &src[(y1 * srcWidth + x1) * 4]
+                };
+
+                u8* out = &dst[(y * dstWidth + x) * 4];
+                for (u32 c = 0; c < 3; c++)
+                {
+                    f32 average = (toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]]) * 0.25f;
+                    out[c] = srgb ? linearToSrgb(average) : (u8)(average * 255.0f + 0.5f);
+                }
+                out[3] = (u8)((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+            }
+        }
+    }
+}
+
+void copyTextureMipLevels(const Texture* texture, u32 firstLevel, Texture* outTexture)
+{
+    ASSERT(firstLevel < texture->mipLevelCount);
+
+    usize firstLevelOffset = texture->levelOffsets[firstLevel];
+    *outTexture = (Texture){
+        .format = texture->format,
+        .width = getLevelExtent(texture->width, firstLevel),
+        .height = getLevelExtent(texture->height, firstLevel),
+        .mipLevelCount = texture->mipLevelCount - firstLevel,
+        .dataSize = texture->dataSize - firstLevelOffset
+    };
+
+    for (u32 i = 0; i < outTexture->mipLevelCount; i++)
+        outTexture->levelOffsets[i] = texture->levelOffsets[firstLevel + i] - firstLevelOffset;
+
+    outTexture->data = mallocOrDie(outTexture->dataSize);
+    memcpy(outTexture->data, texture->data + firstLevelOffset, outTexture->dataSize);
+}
@@ -0,0 +1,51 @@
+#ifndef TEXTURE_FILE_H
+#define TEXTURE_FILE_H
+
+#include "util.h"
+
+#include <vulkan/vulkan.h>
+
+#define TEXTURE_MAX_MIP_LEVELS 16
+// Largest width or height whose full mip chain fits in TEXTURE_MAX_MIP_LEVELS
+#define TEXTURE_MAX_EXTENT (1u << (TEXTURE_MAX_MIP_LEVELS - 1))
+
+// A 2D texture with its mip levels packed back to back in data, largest
+// level first. Every level starts at a multiple of its texel block size.
+typedef struct
+{
+    VkFormat format;
+    u32 width;
+    u32 height;
+    u32 mipLevelCount;
+    u8* data;
+    usize dataSize;
+    usize levelOffsets[TEXTURE_MAX_MIP_LEVELS];
+} Texture;
+
+// Loads a KTX2 or DDS file holding RGBA8, BC1, BC7 or ETC2 data, panicking
+// on anything else
+void loadTextureFile(const char* filename, Texture* outTexture);
+
+// Takes ownership of a tightly packed single level RGBA8 image
+void createRGBA8Texture(u8* pixels, u32 width, u32 height, bool srgb, Texture* outTexture);
+
+void freeTexture(Texture* texture);
+
+bool isCompressedTextureFormat(VkFormat format);
+usize getTextureLevelSize(VkFormat format, u32 width, u32 height);
+
+// Levels down to 1x1, at most TEXTURE_MAX_MIP_LEVELS
+u32 getFullMipLevelCount(u32 width, u32 height);
+
+// Decodes every level of a compressed texture to RGBA8, keeping sRGB-ness
+void decodeTexture(const Texture* texture, Texture* outTexture);
+
+// Box filters level 0 of an RGBA8 texture into a full mip chain, averaging
+// sRGB color in linear space
+void generateTextureMipChain(const Texture* texture, Texture* outTexture);
+
+// Copies the levels from firstLevel on into a texture whose level 0 is
+// firstLevel of the source
+void copyTextureMipLevels(const Texture* texture, u32 firstLevel, Texture* outTexture);
+
+#endif
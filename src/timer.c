@@ -0,0 +1,14 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "timer.h"
+
+#include <time.h>
+
+u64 getTimeNanoseconds(void)
+{
+    struct timespec time;
+    if (clock_gettime(CLOCK_MONOTONIC, &time) != 0)
+        PANIC("%s\n", "Failed to read monotonic clock");
+
+    return (u64)time.tv_sec * 1000000000ull + (u64)time.tv_nsec;
+}
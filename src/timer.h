@@ -0,0 +1,15 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include "util.h"
+
+// Wall clock time from a monotonic source, unaffected by system clock
+// changes and by how much CPU time the process gets
+u64 getTimeNanoseconds(void);
+
+static inline f64 nanosecondsToSeconds(u64 nanoseconds)
+{
+    return nanoseconds / 1e9;
+}
+
+#endif
@@ -57,6 +57,28 @@ static inline void* mallocOrDie(usize size)
     return ptr;
 }
 
+static inline void* reallocOrDie(void* ptr, usize size)
+{
+    void* newPtr = realloc(ptr, size);
+    if (newPtr == NULL && size > 0)
+        PANIC("%s\n", "Failed to reallocate memory");
+    return newPtr;
+}
+
+// Writes string as a quoted JSON string, dropping control characters
+static inline void writeJsonString(FILE* file, const char* string)
+{
+    fputc('"', file);
+    for (const char* c = string; *c != '\0'; c++)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*c >= 0x20)
+            fputc(*c, file);
+    }
+    fputc('"', file);
+}
+
 // Implemented as a macro to avoid having to pass the address of ptr
 // which in turn forces explicit casting in most cases.
 #define freeAndNull(ptr) \
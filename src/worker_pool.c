@@ -0,0 +1,124 @@
+#define _POSIX_C_SOURCE 200112L
+
+#include "worker_pool.h"
+
+#include <pthread.h>
+
+typedef struct
+{
+    WorkerPool* pool;
+    u32 index;
+} WorkerContext;
+
+struct WorkerPool
+{
+    pthread_t* threads;
+    WorkerContext* contexts;
+    u32 workerCount;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t taskAvailable;
+    pthread_cond_t taskFinished;
+
+    WorkerTask task;
+    void* userData;
+    u64 generation;
+    u32 pendingCount;
+    bool shutdown;
+};
+
+static void* workerMain(void* argument)
+{
+    WorkerContext* context = argument;
+    WorkerPool* pool = context->pool;
+    u64 seenGeneration = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->mutex);
+        while (!pool->shutdown && pool->generation == seenGeneration)
+            pthread_cond_wait(&pool->taskAvailable, &pool->mutex);
+
+        if (pool->shutdown)
+        {
+            pthread_mutex_unlock(&pool->mutex);
+            return NULL;
+        }
+
+        seenGeneration = pool->generation;
+        WorkerTask task = pool->task;
+        void* userData = pool->userData;
+        pthread_mutex_unlock(&pool->mutex);
+
+        task(context->index, userData);
+
+        pthread_mutex_lock(&pool->mutex);
+        if (--pool->pendingCount == 0)
+            pthread_cond_signal(&pool->taskFinished);
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+WorkerPool* createWorkerPool(u32 workerCount)
+{
+    ASSERT(workerCount > 0);
+
+    WorkerPool* pool = mallocOrDie(sizeof(WorkerPool));
+    *pool = (WorkerPool){
+        .threads = mallocOrDie(workerCount * sizeof(pthread_t)),
+        .contexts = mallocOrDie(workerCount * sizeof(WorkerContext)),
+        .workerCount = workerCount
+    };
+
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0
+        || pthread_cond_init(&pool->taskAvailable, NULL) != 0
+        || pthread_cond_init(&pool->taskFinished, NULL) != 0)
+        PANIC("%s\n", "Failed to initialize worker pool synchronization");
+
+    for (u32 i = 0; i < workerCount; i++)
+    {
+        pool->contexts[i] = (WorkerContext){.pool = pool, .index = i};
+        if (pthread_create(&pool->threads[i], NULL, workerMain, &pool->contexts[i]) != 0)
+            PANIC("%s\n", "Failed to create worker thread");
+    }
+
+    return pool;
+}
+
+void destroyWorkerPool(WorkerPool* pool)
+{
+    if (pool == NULL)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->shutdown = true;
+    pthread_cond_broadcast(&pool->taskAvailable);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for (u32 i = 0; i < pool->workerCount; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->taskFinished);
+    pthread_cond_destroy(&pool->taskAvailable);
+    pthread_mutex_destroy(&pool->mutex);
+
+    freeAndNull(pool->contexts);
+    freeAndNull(pool->threads);
+    free(pool);
+}
+
+void runWorkerTask(WorkerPool* pool, WorkerTask task, void* userData)
+{
+    ASSERT(task != NULL);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->task = task;
+    pool->userData = userData;
+    pool->pendingCount = pool->workerCount;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->taskAvailable);
+
+    while (pool->pendingCount > 0)
+        pthread_cond_wait(&pool->taskFinished, &pool->mutex);
+    pthread_mutex_unlock(&pool->mutex);
+}
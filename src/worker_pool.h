@@ -0,0 +1,16 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include "util.h"
+
+typedef void (*WorkerTask)(u32 workerIndex, void* userData);
+
+typedef struct WorkerPool WorkerPool;
+
+WorkerPool* createWorkerPool(u32 workerCount);
+void destroyWorkerPool(WorkerPool* pool);
+
+// Runs task once on every worker thread and blocks until all of them return
+void runWorkerTask(WorkerPool* pool, WorkerTask task, void* userData);
+
+#endif